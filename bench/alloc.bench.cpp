@@ -0,0 +1,58 @@
+#include <bench.hpp>
+
+using namespace Propcalc;
+
+/*
+ * Build a formula of `n` distinct binary nodes through Ast::make, so
+ * that each one is a new node in the unique table: a left-leaning chain
+ * of alternating connectives over the variables x1, ..., x64.
+ */
+static Ast::Ref build(size_t n, const std::vector<VarRef>& vars) {
+	Ast::Ref node = Ast::make<Ast::Var>(vars[0]);
+	for (size_t k = 1; k <= n; ++k) {
+		auto x = Ast::make<Ast::Var>(vars[k % vars.size()]);
+		switch (k % 3) {
+		case 0: node = Ast::make<Ast::And>(node, x); break;
+		case 1: node = Ast::make<Ast::Or>(x, node);  break;
+		case 2: node = Ast::make<Ast::Not>(node);    break;
+		}
+	}
+	return node;
+}
+
+int main(void) {
+	std::vector<VarRef> vars;
+	for (unsigned int i = 1; i <= 64; ++i)
+		vars.push_back(Formula::DefaultDomain.resolve("x" + std::to_string(i)));
+
+	/* Slabs are only taken when the free lists are empty, so this is
+	 * measured first, while nothing was freed yet. The nodes of the
+	 * variables are shared and come before. */
+	const size_t before = Pool::reserved();
+	{
+		auto root = build(1000000, vars);
+		std::cout << "pool bytes per node, with its unique table entry: "
+		          << double(Pool::reserved() - before) / 1000000 << std::endl;
+	}
+
+	for (size_t n : { 100000, 1000000 }) {
+		std::cout << n << " nodes" << std::endl;
+		Ast::Ref root;
+		Bench::run("build", 3, [&] {
+			root = nullptr;
+			root = build(n, vars);
+			return root->arity();
+		});
+		Bench::run("copy Formula", 1000000, [&] {
+			Formula fm(root);
+			return fm.root != nullptr;
+		});
+		Bench::run("build and destroy", 3, [&] {
+			root = build(n, vars);
+			root = nullptr;
+			return 1;
+		});
+	}
+
+	return 0;
+}
@@ -0,0 +1,81 @@
+/*
+ * bench.hpp - Minimal benchmark harness
+ *
+ * Copyright (C) 2020 Tobias Boege
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the Artistic License 2.0
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ */
+
+#ifndef PROPCALC_BENCH_HPP
+#define PROPCALC_BENCH_HPP
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <chrono>
+#include <random>
+
+#include <propcalc/propcalc.hpp>
+
+namespace Bench {
+	/**
+	 * Run `fn` `reps` times and print the average wall-clock time per
+	 * repetition. Returns that time in nanoseconds. The function should
+	 * return a value depending on its work, which is accumulated and
+	 * printed, so that the work cannot be optimized away.
+	 */
+	template<typename F>
+	double run(const std::string& name, size_t reps, F&& fn) {
+		using clock = std::chrono::steady_clock;
+		size_t acc = 0;
+		auto start = clock::now();
+		for (size_t i = 0; i < reps; ++i)
+			acc += fn();
+		std::chrono::duration<double, std::nano> took = clock::now() - start;
+		double ns = took.count() / reps;
+		std::cout << std::left << std::setw(48) << name << " "
+		          << std::right << std::setw(14) << std::fixed << std::setprecision(1) << ns << " ns/op"
+		          << "  (" << acc << ")" << std::endl;
+		return ns;
+	}
+
+	/**
+	 * Return a pseudo-random formula over the variables x1, ..., x`nvars`
+	 * with `nodes` binary connectives. It is a random tree whose leaves
+	 * are `nodes + 1` variables, each of which occurs at least once.
+	 * The same seed always gives the same formula.
+	 */
+	static inline Propcalc::Formula random_formula(unsigned int nvars, unsigned int nodes, unsigned int seed = 1) {
+		std::mt19937 rng(seed);
+		std::vector<Propcalc::Formula> pool;
+		for (unsigned int i = 0; i <= nodes; ++i) {
+			unsigned int k = i < nvars ? i : rng() % nvars;
+			pool.push_back(Propcalc::Formula("x" + std::to_string(k + 1)));
+		}
+		while (pool.size() > 1) {
+			std::swap(pool[rng() % pool.size()], pool.back());
+			auto a = pool.back();
+			pool.pop_back();
+			std::swap(pool[rng() % pool.size()], pool.back());
+			auto b = pool.back();
+			pool.pop_back();
+			switch (rng() % 6) {
+			case 0: pool.push_back(a & b);       break;
+			case 1: pool.push_back(a | b);       break;
+			case 2: pool.push_back(a.thenf(b));  break;
+			case 3: pool.push_back(a.eqvf(b));   break;
+			case 4: pool.push_back(a ^ b);       break;
+			case 5: pool.push_back(~a & b);      break;
+			}
+		}
+		return pool.back();
+	}
+}
+
+#endif /* PROPCALC_BENCH_HPP */
@@ -0,0 +1,31 @@
+#include <bench.hpp>
+
+using namespace Propcalc;
+
+int main(void) {
+	Formula fm = Bench::random_formula(22, 220);
+	const uint64_t rows = uint64_t(1) << fm.vars().size();
+	std::cout << "formula with " << fm.vars().size() << " variables, "
+	          << rows << " rows" << std::endl;
+
+	/* Count the satisfying rows of the whole truth table. */
+	Bench::run("Truthtable (sliced)", 1, [&] {
+		size_t sat = 0;
+		for (auto [assign, value] : fm.truthtable(false, true))
+			sat += value;
+		return sat;
+	});
+	Bench::run("Formula::truthtable_bits", 1, [&] {
+		return fm.truthtable_bits().count();
+	});
+
+	Bittable bt = fm.truthtable_bits();
+	std::cout << "packed table: " << 8 * bt.words().size() << " bytes" << std::endl;
+	Bench::run("Bittable, iterate satisfying rows", 1, [&] {
+		size_t acc = 0;
+		for (uint64_t r : bt)
+			acc += r & 1;
+		return acc;
+	});
+	return 0;
+}
@@ -0,0 +1,62 @@
+#include <bench.hpp>
+
+using namespace Propcalc;
+
+int main(void) {
+	/* A random 3-CNF, as DIMACS::read would produce it. */
+	std::mt19937 rng(1);
+	auto lit = [&] {
+		return std::string(rng() % 2 ? "~" : "") + "x" + std::to_string(rng() % 300 + 1);
+	};
+	Formula fm("\\T");
+	for (unsigned int i = 0; i < 1200; ++i)
+		fm = fm & Formula(lit() + " | " + lit() + " | " + lit());
+	std::cout << "3-CNF with " << fm.vars().size() << " variables, 1200 clauses" << std::endl;
+
+	Bench::run("CNF of a clausal formula", 10, [&] {
+		size_t clauses = 0;
+		for (auto cl : fm.cnf())
+			clauses += cl.size() > 0;
+		return clauses;
+	});
+
+	/* A non-clausal formula, with and without minimization. */
+	Formula dense = Bench::random_formula(12, 40, 4) & Bench::random_formula(8, 30, 5);
+	for (bool minimize : { false, true }) {
+		size_t clauses = 0, literals = 0;
+		for (auto cl : dense.cnf(false, minimize)) {
+			clauses++;
+			literals += cl.size();
+		}
+		std::cout << (minimize ? "minimized: " : "plain:     ") << clauses
+		          << " clauses, " << literals << " literals" << std::endl;
+		Bench::run(std::string("CNF of a random formula") + (minimize ? " (minimized)" : ""), 10, [&] {
+			size_t n = 0;
+			for (auto cl : dense.cnf(false, minimize))
+				n += cl.size() > 0;
+			return n;
+		});
+	}
+
+	/* Many independent non-clausal conjuncts, on one and on all threads. */
+	Formula many("\\T");
+	for (unsigned int i = 0; i < 32; ++i)
+		many = many & Bench::random_formula(10, 25, 100 + i);
+	Bench::run("CNF of 32 random conjuncts", 5, [&] {
+		size_t n = 0;
+		for (auto cl : many.cnf())
+			n += cl.size() > 0;
+		return n;
+	});
+#ifndef PROPCALC_SINGLE_THREADED
+	for (bool ordered : { true, false }) {
+		Bench::run(std::string("ParallelCNF of 32 random conjuncts") + (ordered ? " (ordered)" : ""), 5, [&] {
+			size_t n = 0;
+			for (auto cl : many.cnf_parallel(0, ordered))
+				n += cl.size() > 0;
+			return n;
+		});
+	}
+#endif
+	return 0;
+}
@@ -0,0 +1,159 @@
+#include <bench.hpp>
+
+using namespace Propcalc;
+
+/* A copy of the subtree whose nodes are not interned, so that comparing
+ * it to the original has to look at every node. */
+static Ast::Ref copy(const Ast::Ref& root) {
+	Ast::PostOrder<Ast::Ref> walk;
+	return walk.run(root.get(), [] (const Ast* node, const Ast::Ref* v, size_t) -> Ast::Ref {
+		switch (node->type()) {
+		case Ast::Type::Const: return Ast::fresh<Ast::Const>(static_cast<const Ast::Const*>(node)->value);
+		case Ast::Type::Var:   return Ast::fresh<Ast::Var>(static_cast<const Ast::Var*>(node)->var);
+		case Ast::Type::Not:   return Ast::fresh<Ast::Not>(v[0]);
+		case Ast::Type::And:   return Ast::fresh<Ast::And>(v[0], v[1]);
+		case Ast::Type::Or:    return Ast::fresh<Ast::Or>(v[0], v[1]);
+		case Ast::Type::Impl:  return Ast::fresh<Ast::Impl>(v[0], v[1]);
+		case Ast::Type::Eqv:   return Ast::fresh<Ast::Eqv>(v[0], v[1]);
+		case Ast::Type::Xor:   return Ast::fresh<Ast::Xor>(v[0], v[1]);
+		default:
+			throw std::logic_error("unexpected n-ary node");
+		}
+	});
+}
+
+/*
+ * The recursive evaluation and comparison which the nodes did before the
+ * traversals were made iterative: one call per level, shortcuts only by
+ * identity and interning. They are the reference for the shallow case.
+ */
+static bool eval_recursive(const Ast* node, const Assignment& assign) {
+	switch (node->type()) {
+	case Ast::Type::Const: return static_cast<const Ast::Const*>(node)->value;
+	case Ast::Type::Var:   return assign[static_cast<const Ast::Var*>(node)->var];
+	case Ast::Type::Not:   return !eval_recursive(node->operand(0).get(), assign);
+	default:
+		break;
+	}
+	const Ast* lhs = node->operand(0).get();
+	const Ast* rhs = node->operand(1).get();
+	switch (node->type()) {
+	case Ast::Type::And:  return eval_recursive(lhs, assign) && eval_recursive(rhs, assign);
+	case Ast::Type::Or:   return eval_recursive(lhs, assign) || eval_recursive(rhs, assign);
+	case Ast::Type::Impl: return !eval_recursive(lhs, assign) || eval_recursive(rhs, assign);
+	case Ast::Type::Eqv:  return eval_recursive(lhs, assign) == eval_recursive(rhs, assign);
+	case Ast::Type::Xor:  return eval_recursive(lhs, assign) != eval_recursive(rhs, assign);
+	default:
+		throw std::logic_error("unexpected n-ary node");
+	}
+}
+
+static bool equals_recursive(const Ast* a, const Ast* b) {
+	if (a == b)
+		return true;
+	if (a->interned && b->interned)
+		return false;
+	if (a->type() != b->type())
+		return false;
+	switch (a->type()) {
+	case Ast::Type::Const:
+		return static_cast<const Ast::Const*>(a)->value == static_cast<const Ast::Const*>(b)->value;
+	case Ast::Type::Var:
+		return static_cast<const Ast::Var*>(a)->var == static_cast<const Ast::Var*>(b)->var;
+	case Ast::Type::Not:
+		return equals_recursive(a->operand(0).get(), b->operand(0).get());
+	default:
+		return equals_recursive(a->operand(0).get(), b->operand(0).get())
+		    && equals_recursive(a->operand(1).get(), b->operand(1).get());
+	}
+}
+
+/*
+ * A chain of `depth` nodes cycling through negation, exclusive or,
+ * disjunction and conjunction with the variables x1, ..., x16. The
+ * chain is always the operand which is evaluated first, or both are.
+ * It is made without the unique table, like a formula read from a
+ * file, and its value on `assign` is computed on the side.
+ */
+static Ast::Ref chain(size_t depth, const Assignment& assign, bool& value) {
+	std::vector<Ast::Ref> vars;
+	for (auto& v : assign.vars())
+		vars.push_back(Ast::fresh<Ast::Var>(v));
+
+	Ast::Ref node = vars[0];
+	value = assign[assign.vars()[0]];
+	for (size_t k = 1; k < depth; ++k) {
+		auto& x = vars[k % vars.size()];
+		bool b = assign[assign.vars()[k % vars.size()]];
+		switch (k % 4) {
+		case 0: node = Ast::fresh<Ast::Not>(node);    value = !value;        break;
+		case 1: node = Ast::fresh<Ast::Xor>(x, node); value = value != b;    break;
+		case 2: node = Ast::fresh<Ast::Or>(node, x);  value = value || b;    break;
+		case 3: node = Ast::fresh<Ast::And>(node, x); value = value && b;    break;
+		}
+	}
+	return node;
+}
+
+int main(void) {
+	/* Shallow formulas take the recursive fast paths. */
+	Formula fm = Bench::random_formula(16, 400);
+	auto twin = copy(fm.root);
+	std::vector<Assignment> assigns;
+	Assignment assign = fm.assignment();
+	for (unsigned int i = 0; i < 1024; ++i) {
+		assigns.push_back(assign);
+		for (unsigned int k = 0; k < 37; ++k)
+			++assign;
+	}
+	Assignment half;
+	for (size_t k = 0; k < fm.vars().size(); k += 2)
+		half[fm.vars()[k]] = bool(assign[fm.vars()[k]]);
+	Assignment one;
+	one[fm.vars()[0]] = true;
+
+	std::cout << "formula with 401 leaves" << std::endl;
+	size_t i = 0;
+	Bench::run("eval", 100000, [&] { return fm.eval(assigns[i++ % assigns.size()]); });
+	i = 0;
+	Bench::run("eval (recursive reference)", 100000, [&] {
+		return eval_recursive(fm.root.get(), assigns[i++ % assigns.size()]);
+	});
+	Bench::run("equals (not interned)", 10000, [&] { return fm.root->equals(*twin); });
+	Bench::run("equals (recursive reference)", 10000, [&] {
+		return equals_recursive(fm.root.get(), twin.get());
+	});
+	Bench::run("simplify (half assigned)", 1000, [&] { return fm.simplify(half).root->type() != Ast::Type::Const; });
+	Bench::run("simplify (one assigned)", 1000, [&] { return fm.simplify(one).root != fm.root; });
+	Bench::run("to_postfix", 1000, [&] { return fm.to_postfix().size(); });
+	Bench::run("to_infix", 1000, [&] { return fm.to_infix().size(); });
+	Bench::run("Tseitin construction", 1000, [&] { return fm.tseitin().domain->size(); });
+
+	/* Deep chains take the iterative paths. */
+	for (size_t depth : { 1000000, 10000000 }) {
+		bool value;
+		auto deep = chain(depth, assign, value);
+		bool twin_value;
+		auto deep_twin = chain(depth, assign, twin_value);
+		std::cout << "chain of depth " << depth << ", value " << value << std::endl;
+
+		Bench::run("eval", 1, [&] { return deep->eval(assign) == value; });
+		Bench::run("equals (not interned)", 1, [&] { return deep->equals(*deep_twin); });
+		Bench::run("simplify (all assigned)", 1, [&] {
+			return Ast::simplify(deep, assign) == Ast::constant(value);
+		});
+		Bench::run("to_postfix", 1, [&] { return deep->to_postfix().size(); });
+		Bench::run("to_infix", 1, [&] { return deep->to_infix().size(); });
+		Bench::run("destruction", 1, [&] {
+			deep_twin.reset();
+			return 1;
+		});
+		/* The transform of the 10M chain peaks at about 4 GB by itself,
+		 * so it runs after the twin is freed. */
+		Bench::run("Tseitin construction", 1, [&] {
+			return Formula(deep).tseitin().domain->size();
+		});
+	}
+
+	return 0;
+}
@@ -0,0 +1,66 @@
+#include <thread>
+
+#include <bench.hpp>
+
+using namespace Propcalc;
+
+/* Run `fn(t)` on `n` threads at once and return the sum of the results. */
+template<typename F>
+static size_t parallel(unsigned int n, F&& fn) {
+	std::vector<size_t> results(n);
+	std::vector<std::thread> threads;
+	for (unsigned int t = 0; t < n; ++t)
+		threads.emplace_back([&, t] { results[t] = fn(t); });
+	for (auto& th : threads)
+		th.join();
+	size_t acc = 0;
+	for (auto r : results)
+		acc += r;
+	return acc;
+}
+
+int main(void) {
+	/* All threads share the default domain, like most programs do. */
+	Cache& domain = Formula::DefaultDomain;
+	std::vector<std::string> names;
+	std::vector<VarRef> vars;
+	for (unsigned int i = 1; i <= 1024; ++i) {
+		names.push_back("x" + std::to_string(i));
+		vars.push_back(domain.resolve(names.back()));
+	}
+	std::string text = "x1";
+	for (unsigned int i = 2; i <= 256; ++i)
+		text += (i % 3 ? " & x" : " | ~x") + std::to_string(i);
+
+	/* Each line is the time for all threads together to do the work. */
+	const size_t lookups = 1000000, parses = 4000;
+	for (unsigned int n : { 1, 2, 4, 8 }) {
+		std::cout << n << " threads" << std::endl;
+		Bench::run("resolve, 1M names", 1, [&] {
+			return parallel(n, [&] (unsigned int t) {
+				size_t acc = 0;
+				for (size_t k = 0; k < lookups / n; ++k)
+					acc += domain.resolve(names[(k + t) % names.size()]) == vars[(k + t) % vars.size()];
+				return acc;
+			});
+		});
+		Bench::run("pack and unpack, 1M variables", 1, [&] {
+			return parallel(n, [&] (unsigned int t) {
+				size_t acc = 0;
+				for (size_t k = 0; k < lookups / n; ++k)
+					acc += domain.unpack(domain.pack(vars[(k + t) % vars.size()])) == vars[(k + t) % vars.size()];
+				return acc;
+			});
+		});
+		Bench::run("parse, 4000 formulas of 256 variables", 1, [&] {
+			return parallel(n, [&] (unsigned int) {
+				size_t acc = 0;
+				for (size_t k = 0; k < parses / n; ++k)
+					acc += Formula(text).root->arity();
+				return acc;
+			});
+		});
+	}
+
+	return 0;
+}
@@ -0,0 +1,33 @@
+#include <bench.hpp>
+
+using namespace Propcalc;
+
+int main(void) {
+	Formula fm = Bench::random_formula(16, 400);
+	CompiledFormula cf(fm);
+	std::cout << "formula with " << fm.vars().size() << " variables, "
+	          << cf.program().size() << " instructions" << std::endl;
+
+	/* Evaluate both representations on the same assignments. */
+	std::vector<Assignment> assigns;
+	std::vector<std::vector<bool>> bits;
+	Assignment assign = fm.assignment();
+	for (unsigned int i = 0; i < 1024; ++i) {
+		assigns.push_back(assign);
+		std::vector<bool> b;
+		for (auto& v : cf.vars())
+			b.push_back(assign[v]);
+		bits.push_back(b);
+		for (unsigned int k = 0; k < 37; ++k)
+			++assign;
+	}
+
+	size_t i = 0, j = 0;
+	Bench::run("Formula::eval", 100000, [&] {
+		return fm.eval(assigns[i++ % assigns.size()]);
+	});
+	Bench::run("CompiledFormula::eval(bits)", 100000, [&] {
+		return cf.eval(bits[j++ % bits.size()]);
+	});
+	return 0;
+}
@@ -0,0 +1,37 @@
+#include <bench.hpp>
+
+using namespace Propcalc;
+
+int main(void) {
+	Formula fm = Bench::random_formula(18, 400);
+	const uint64_t rows = uint64_t(1) << fm.vars().size();
+	std::cout << "formula with " << fm.vars().size() << " variables, "
+	          << fm.compile().program().size() << " instructions, "
+	          << rows << " rows" << std::endl;
+
+	/* Count the satisfying rows of the whole truth table. */
+	Bench::run("Truthtable", 1, [&] {
+		size_t sat = 0;
+		auto tt = fm.truthtable();
+		while (tt)
+			sat += (++tt).eval();
+		return sat;
+	});
+	Bench::run("Truthtable (gray)", 1, [&] {
+		size_t sat = 0;
+		auto tt = fm.truthtable_gray();
+		while (tt)
+			sat += (++tt).eval();
+		return sat;
+	});
+
+	/* A conjunction of small formulas makes many clauses. */
+	Formula cnffm = Bench::random_formula(14, 60, 2) & Bench::random_formula(14, 60, 3);
+	Bench::run("CNF, 2 conjuncts on 14 variables", 1, [&] {
+		size_t clauses = 0;
+		for (auto cl : cnffm.cnf())
+			clauses += cl.size() > 0;
+		return clauses;
+	});
+	return 0;
+}
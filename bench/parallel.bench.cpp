@@ -0,0 +1,29 @@
+#include <thread>
+#include <atomic>
+
+#include <bench.hpp>
+
+using namespace Propcalc;
+
+int main(void) {
+	Formula fm = Bench::random_formula(28, 120);
+	const uint64_t rows = uint64_t(1) << fm.vars().size();
+	std::cout << "formula with " << fm.vars().size() << " variables, "
+	          << rows << " rows" << std::endl;
+
+	/* Count and filter the whole truth table on more and more threads. */
+	const unsigned int hw = std::max(1U, std::thread::hardware_concurrency());
+	for (unsigned int threads = 1; threads <= hw; threads *= 2) {
+		ParallelTruthtable pt(fm, threads);
+		const std::string suffix = ", " + std::to_string(threads) + " threads";
+		Bench::run("ParallelTruthtable::count" + suffix, 1, [&] {
+			return pt.count();
+		});
+		Bench::run("ParallelTruthtable::for_each" + suffix, 1, [&] {
+			std::atomic<uint64_t> odd(0);
+			pt.for_each([&] (uint64_t r) { odd += r & 1; });
+			return odd.load();
+		});
+	}
+	return 0;
+}
@@ -0,0 +1,73 @@
+#include <sstream>
+
+#include <bench.hpp>
+
+using namespace Propcalc;
+
+/* A stream which only counts the characters written to it. */
+class Counter : public std::streambuf {
+	size_t n = 0;
+
+protected:
+	std::streamsize xsputn(const char*, std::streamsize count) override {
+		n += count;
+		return count;
+	}
+
+	int_type overflow(int_type c) override {
+		n++;
+		return c;
+	}
+
+public:
+	size_t count(void) const { return n; }
+};
+
+int main(void) {
+	/* Wide formulas of several megabytes of text. */
+	for (unsigned int nodes : { 100000, 1000000 }) {
+		Formula fm = Bench::random_formula(64, nodes);
+		std::cout << "formula with " << nodes + 1 << " leaves, "
+		          << fm.to_infix().size() / 1000000.0 << " MB infix" << std::endl;
+
+		Bench::run("to_infix", 3, [&] { return fm.to_infix().size(); });
+		Bench::run("to_prefix", 3, [&] { return fm.to_prefix().size(); });
+		Bench::run("to_postfix", 3, [&] { return fm.to_postfix().size(); });
+
+		std::string buffer;
+		Bench::run("write_infix, reused buffer", 3, [&] {
+			buffer.clear();
+			fm.write_infix(buffer);
+			return buffer.size();
+		});
+		Bench::run("write_infix, std::ostringstream", 3, [&] {
+			std::ostringstream os;
+			fm.write_infix(os);
+			return os.tellp();
+		});
+		Bench::run("write_infix, counting stream", 3, [&] {
+			Counter counter;
+			std::ostream os(&counter);
+			fm.write_infix(os);
+			return counter.count();
+		});
+	}
+
+	/* A deep chain, where concatenating the strings of the subtrees
+	 * used to be quadratic. */
+	for (size_t depth : { 1000000, 4000000 }) {
+		Formula fm("x1");
+		for (size_t k = 1; k < depth; ++k) {
+			Formula x("x" + std::to_string(k % 16 + 1));
+			fm = k % 2 ? (fm | x) : ~fm;
+		}
+		std::cout << "chain of depth " << depth << ", "
+		          << fm.to_infix().size() / 1000000.0 << " MB infix" << std::endl;
+
+		Bench::run("to_infix", 3, [&] { return fm.to_infix().size(); });
+		Bench::run("to_prefix", 3, [&] { return fm.to_prefix().size(); });
+		Bench::run("to_postfix", 3, [&] { return fm.to_postfix().size(); });
+	}
+
+	return 0;
+}
@@ -0,0 +1,41 @@
+#include <bench.hpp>
+
+using namespace Propcalc;
+
+int main(void) {
+	Formula fm = Bench::random_formula(20, 200);
+	CompiledFormula cf(fm);
+	const uint64_t rows = uint64_t(1) << fm.vars().size();
+	std::cout << "formula with " << fm.vars().size() << " variables, "
+	          << cf.program().size() << " instructions, "
+	          << rows << " rows" << std::endl;
+
+	/* Count the satisfying rows of the whole truth table. */
+	Bench::run("Truthtable", 1, [&] {
+		size_t sat = 0;
+		for (auto [assign, value] : fm.truthtable())
+			sat += value;
+		return sat;
+	});
+	Bench::run("Truthtable (sliced)", 1, [&] {
+		size_t sat = 0;
+		for (auto [assign, value] : fm.truthtable(false, true))
+			sat += value;
+		return sat;
+	});
+
+	for (unsigned int words : { 1, 4, 8 }) {
+		std::vector<uint64_t> out(words);
+		Bench::run("CompiledFormula::eval_rows, " + std::to_string(words) + " words", 1, [&] {
+			size_t sat = 0;
+			for (uint64_t r = 0; r < rows; r += 64 * words) {
+				cf.eval_rows(r, out.data(), words);
+				for (auto w : out)
+					sat += __builtin_popcountll(w);
+			}
+			return sat;
+		});
+	}
+	std::cout << "native words: " << CompiledFormula::native_words() << std::endl;
+	return 0;
+}
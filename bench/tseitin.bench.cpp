@@ -0,0 +1,113 @@
+#include <bench.hpp>
+
+using namespace Propcalc;
+
+/*
+ * A formula of depth 2d whose tree has about 2^d leaves but which, as a
+ * DAG, has only O(d) nodes, because each level uses the previous one
+ * twice.
+ */
+static Formula shared_chain(unsigned int depth) {
+	Formula fm("x0");
+	for (unsigned int i = 1; i <= depth; ++i) {
+		Formula x("x" + std::to_string(i)), y("y" + std::to_string(i));
+		fm = fm.andf(x).orf(fm.xorf(y));
+	}
+	return fm;
+}
+
+/* A balanced tree of And, Or and Xor over 2^k distinct variables. */
+static Formula balanced(unsigned int k) {
+	std::vector<Formula> level;
+	for (unsigned int i = 0; i < (1U << k); ++i)
+		level.push_back(Formula("x" + std::to_string(i)));
+	for (unsigned int d = 0; level.size() > 1; ++d) {
+		std::vector<Formula> next;
+		for (size_t i = 0; i < level.size(); i += 2) {
+			switch ((d + i / 2) % 3) {
+			case 0: next.push_back(level[i] & level[i + 1]); break;
+			case 1: next.push_back(level[i] | level[i + 1]); break;
+			case 2: next.push_back(level[i] ^ level[i + 1]); break;
+			}
+		}
+		level = std::move(next);
+	}
+	return level[0];
+}
+
+int main(void) {
+	for (unsigned int depth : { 8, 12, 16 }) {
+		Formula fm = shared_chain(depth);
+		for (bool polarity : { false, true }) {
+			size_t clauses = fm.tseitin(true, polarity).cache_all();
+			std::cout << "depth " << depth << (polarity ? ", polarity: " : ":           ")
+			          << clauses << " clauses" << std::endl;
+			Bench::run("Tseitin of a shared chain, depth " + std::to_string(depth) +
+					(polarity ? " (polarity)" : ""), 10, [&] {
+				size_t n = 0;
+				for (auto cl : fm.tseitin(false, polarity))
+					n += cl.size();
+				return n;
+			});
+		}
+	}
+
+	/* Constructing the stream should be linear in the number of nodes. */
+	for (unsigned int k : { 15, 17, 19 }) {
+		Formula fm = balanced(k);
+		Bench::run("Tseitin construction, " + std::to_string((2U << k) - 1) + " nodes", 1, [&] {
+			return fm.tseitin().domain->size();
+		});
+	}
+
+	/* Lifting and projecting should be linear in the number of nodes. */
+	for (auto& fm : { shared_chain(16), balanced(15) }) {
+		Tseitin tsei = fm.tseitin();
+		Assignment assign = fm.assignment();
+		std::cout << "lift and project on " << tsei.domain->size() << " Tseitin variables" << std::endl;
+		Bench::run("Tseitin lift and project", 100, [&] {
+			++assign;
+			return tsei.project(tsei.lift(assign)).size();
+		});
+	}
+
+	/* A CNF built by the connectives is a chain of binary nodes. After
+	 * flattening, each clause and the conjunction get one variable. */
+	{
+		std::mt19937 rng(1);
+		auto lit = [&] {
+			Formula x("x" + std::to_string(rng() % 500));
+			return rng() % 2 ? x : ~x;
+		};
+		Formula cnf = lit() | lit() | lit();
+		for (unsigned int i = 1; i < 5000; ++i)
+			cnf = cnf & (lit() | lit() | lit() | lit());
+		for (auto& fm : { cnf, cnf.flatten() }) {
+			std::cout << (fm.root == cnf.root ? "binary" : "n-ary") << ": "
+			          << fm.tseitin().domain->size() << " Tseitin variables" << std::endl;
+			Bench::run(std::string("Tseitin of a 4-CNF, ") + (fm.root == cnf.root ? "binary" : "n-ary"), 10, [&] {
+				size_t n = 0;
+				for (const auto& cl : fm.tseitin())
+					n += cl.size();
+				return n;
+			});
+		}
+	}
+
+	/* Streaming the clauses should not allocate per clause. */
+	Formula big = balanced(19);
+	Bench::run("Tseitin clauses, " + std::to_string((2U << 19) - 1) + " nodes", 1, [&] {
+		size_t n = 0;
+		for (const auto& cl : big.tseitin())
+			n += cl.size();
+		return n;
+	});
+	Bench::run("CNF clauses, 4 random conjuncts", 1, [&] {
+		size_t n = 0;
+		for (const auto& cl : (Bench::random_formula(16, 50, 1) & Bench::random_formula(16, 50, 2) &
+				Bench::random_formula(16, 50, 3) & Bench::random_formula(16, 50, 4)).cnf())
+			n += cl.size();
+		return n;
+	});
+	return 0;
+}
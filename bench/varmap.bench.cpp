@@ -0,0 +1,35 @@
+#include <bench.hpp>
+
+using namespace Propcalc;
+
+int main(void) {
+	for (unsigned int n : { 8, 32, 128 }) {
+		std::vector<VarRef> vars;
+		for (unsigned int i = 1; i <= n; ++i)
+			vars.push_back(Formula::DefaultDomain.resolve("x" + std::to_string(i)));
+		const std::string suffix = ", " + std::to_string(n) + " variables";
+
+		Assignment assign(vars);
+		Bench::run("Assignment::operator++" + suffix, 1000000, [&] {
+			++assign;
+			return assign[vars[0]];
+		});
+
+		Bench::run("Assignment copy" + suffix, 1000000, [&] {
+			Assignment copy(assign);
+			return copy[vars[n - 1]];
+		});
+
+		/* A clause on every other variable, which the assignment falsifies
+		 * unless one of its last literals is hit. */
+		Clause cl;
+		for (unsigned int i = 0; i < n; i += 2)
+			cl[vars[i]] = !assign[vars[i]];
+		cl[vars[n - 1]] = true;
+		Bench::run("Clause::eval" + suffix, 1000000, [&] {
+			assign[vars[n - 1]] = !assign[vars[n - 1]];
+			return cl.eval(assign);
+		});
+	}
+	return 0;
+}
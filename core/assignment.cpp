@@ -12,30 +12,64 @@
  * Artistic License 2.0 for more details.
  */
 
+#include <stdexcept>
+
 #include <propcalc/assignment.hpp>
 
 using namespace std;
 
 namespace Propcalc {
 
+Assignment::Assignment(vector<VarRef> vars, uint64_t r) :
+	VarMap(vars), overflow(false)
+{
+	if (bits.empty())
+		return;
+	bits[0] = r;
+	if (bits.size() == 1)
+		mask_tail();
+}
+
+uint64_t Assignment::rank(void) const {
+	if (order.size() > 64)
+		throw length_error("Rank of an Assignment needs at most 64 variables");
+	return bits.empty() ? 0 : bits[0];
+}
+
+uint64_t Assignment::rank(const vector<VarRef>& vars) const {
+	if (vars.size() > 64)
+		throw length_error("Rank of an Assignment needs at most 64 variables");
+	if (vars == order)
+		return rank();
+	uint64_t r = 0;
+	for (size_t i = 0; i < vars.size(); ++i)
+		r |= uint64_t((*this)[vars[i]]) << i;
+	return r;
+}
+
 Assignment Assignment::operator~(void) const {
-	Assignment neg(order);
-	for (auto& v : order)
-		neg[v] = !vmap.at(v);
+	Assignment neg(*this);
+	for (auto& w : neg.bits)
+		w = ~w;
+	neg.mask_tail();
 	return neg;
 }
 
 Assignment& Assignment::operator++(void) {
-	/* Use the given order to implement a (consistent) binary incrementer
-	 * which adheres to the variable order given at construction. */
-	size_t n = 0;
-	for (auto& v : order) {
-		bool bit = vmap.at(v) ^= true;
-		if (bit)
+	/* The variable at position i is bit i of a binary number, so that
+	 * the increment adheres to the variable order given at construction.
+	 * It overflows if the carry runs out of the last word. */
+	const size_t n = order.size();
+	overflow = true;
+	for (size_t k = 0; k < bits.size(); ++k) {
+		bits[k]++;
+		if (k == bits.size() - 1 && n % 64)
+			bits[k] &= (uint64_t(1) << (n % 64)) - 1;
+		if (bits[k]) {
+			overflow = false;
 			break;
-		n++;
+		}
 	}
-	overflow = n >= vmap.size();
 	return *this;
 }
 
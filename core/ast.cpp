@@ -12,6 +12,10 @@
  * Artistic License 2.0 for more details.
  */
 
+#include <stack>
+#include <ostream>
+#include <unordered_map>
+
 #include <propcalc/ast.hpp>
 
 using namespace std;
@@ -19,203 +23,674 @@ using namespace std;
 namespace Propcalc {
 
 /*
- * Ast::Not
+ * Ast::Table
  */
 
-shared_ptr<Ast> Ast::Not::simplify(const Assignment& assign) const {
-	auto newrhs = rhs->simplify(assign);
-	/* Remove double negations */
-	size_t toggles = 1;
-	while (newrhs->type() == Ast::Type::Not) {
-		newrhs = static_cast<Ast::Not*>(newrhs.get())->rhs;
-		++toggles;
+Ast::Table Ast::table;
+
+#ifdef PROPCALC_SINGLE_THREADED
+
+void Ast::Table::grow(void) {
+	const size_t n = buckets ? 2 * (mask + 1) : 1024;
+	Ast** bigger = new Ast*[n]();
+	for (size_t i = 0; buckets && i <= mask; ++i) {
+		for (Ast* node = buckets[i]; node; ) {
+			Ast* next = node->next_entry;
+			node->next_entry = bigger[node->hash & (n - 1)];
+			bigger[node->hash & (n - 1)] = node;
+			node = next;
+		}
 	}
-	if (toggles % 2 == 0)
-		return newrhs;
-	/* Reduce Not Const */
-	if (newrhs->type() == Ast::Type::Const) {
-		return make_shared<Ast::Const>(
-			not static_cast<Ast::Const*>(newrhs.get())->value
-		);
+	delete[] buckets;
+	buckets = bigger;
+	mask = n - 1;
+}
+
+void Ast::Table::unlink(Ast* node) {
+	if (!buckets)
+		return;
+	for (Ast** link = &buckets[node->hash & mask]; *link; link = &(*link)->next_entry) {
+		if (*link == node) {
+			*link = node->next_entry;
+			count--;
+			return;
+		}
 	}
-	return make_shared<Ast::Not>(newrhs);
 }
 
-string Ast::Not::to_infix(void) const {
-	string op = rhs->to_infix();
-	if (rhs->prec() < this->prec())
-		op = "(" + op + ")";
-	return "~" + op;
+void Ast::dispose(Ast* node) {
+	table.unlink(node);
+	delete node;
 }
 
-string Ast::Not::to_prefix(void) const {
-	return "~ " + rhs->to_prefix();
+#else
+
+void Ast::Table::sweep(void) {
+	for (auto it = nodes.begin(); it != nodes.end(); ) {
+		if (it->second.expired())
+			it = nodes.erase(it);
+		else
+			++it;
+	}
+	threshold = max(threshold, 2 * nodes.size());
 }
 
-string Ast::Not::to_postfix(void) const {
-	return rhs->to_postfix() + " ~";
+size_t Ast::Table::size(void) {
+	const lock_guard<mutex> lock(access);
+	return nodes.size();
 }
 
+#endif
+
 /*
- * Ast::And
+ * Ast
  */
 
-shared_ptr<Ast> Ast::And::simplify(const Assignment& assign) const {
-	auto newlhs = lhs->simplify(assign);
-	auto newrhs = rhs->simplify(assign);
-	if (newlhs->type() == Ast::Type::Const) {
-		return static_cast<Ast::Const*>(newlhs.get())->value
-			? newrhs : make_shared<Ast::Const>(false);
+void Ast::release(Ast::Ref& op) {
+	/* The queue of the outermost call. It is not a thread_local vector
+	 * itself, which could be destroyed before static formulas are. */
+	static thread_local vector<Ast::Ref>* pending = nullptr;
+
+	/* Somebody else keeps the operand alive. */
+	if (op.use_count() != 1)
+		return;
+	if (pending) {
+		pending->push_back(move(op));
+		return;
 	}
-	if (newrhs->type() == Ast::Type::Const) {
-		return static_cast<Ast::Const*>(newrhs.get())->value
-			? newlhs : make_shared<Ast::Const>(false);
+
+	/* Destroying a node releases its operands, which only queues them. */
+	vector<Ast::Ref> queue;
+	pending = &queue;
+	op.reset();
+	while (!queue.empty()) {
+		auto node = move(queue.back());
+		queue.pop_back();
+		node.reset();
 	}
-	return make_shared<Ast::And>(newlhs, newrhs);
+	pending = nullptr;
 }
 
-static inline string _to_infix(string sym, const Ast* lhs, const Ast* infix, const Ast* rhs) {
-	string op1 = lhs->to_infix();
-	string op2 = rhs->to_infix();
+/* Compare the nodes but not their operands. */
+static inline bool same_node(const Ast* x, const Ast* y) {
+	if (x->type() != y->type())
+		return false;
+	switch (x->type()) {
+	case Ast::Type::Const:
+		return static_cast<const Ast::Const*>(x)->value == static_cast<const Ast::Const*>(y)->value;
+	case Ast::Type::Var:
+		return static_cast<const Ast::Var*>(x)->var == static_cast<const Ast::Var*>(y)->var;
+	default:
+		return x->arity() == y->arity();
+	}
+}
 
-	if (lhs->prec() < infix->prec())
-		op1 = "(" + op1 + ")";
-	if (rhs->prec() < infix->prec())
-		op2 = "(" + op2 + ")";
-	return op1 + " " + sym + " " + op2;
+static bool equals_iterative(const Ast* a, const Ast* b) {
+	vector<pair<const Ast*, const Ast*>> todo{ { a, b } };
+	while (!todo.empty()) {
+		auto [x, y] = todo.back();
+		todo.pop_back();
+		if (x == y)
+			continue;
+		if (x->interned && y->interned)
+			return false;
+		if (!same_node(x, y))
+			return false;
+		for (size_t i = x->arity(); i-- > 0; )
+			todo.push_back({ x->operand(i).get(), y->operand(i).get() });
+	}
+	return true;
 }
 
-string Ast::And::to_infix(void) const {
-	return _to_infix("&", lhs.get(), this, rhs.get());
+/*
+ * Recurse up to Ast::RECURSION levels, then continue on an explicit stack.
+ * The operands are reached through the node's fields, without going
+ * through `operand` once per index, which is what makes this as fast as
+ * the plain recursion on shallow formulas.
+ */
+static bool equals_at(const Ast* x, const Ast* y, size_t depth) {
+	if (x == y)
+		return true;
+	if (x->interned && y->interned)
+		return false;
+	if (depth >= Ast::RECURSION)
+		return equals_iterative(x, y);
+	if (x->kind != y->kind)
+		return false;
+
+	switch (x->kind) {
+	case Ast::Type::Const:
+		return static_cast<const Ast::Const*>(x)->value == static_cast<const Ast::Const*>(y)->value;
+	case Ast::Type::Var:
+		return static_cast<const Ast::Var*>(x)->var == static_cast<const Ast::Var*>(y)->var;
+	case Ast::Type::Not:
+		return equals_at(static_cast<const Ast::Not*>(x)->rhs.get(),
+			static_cast<const Ast::Not*>(y)->rhs.get(), depth + 1);
+	case Ast::Type::AndN:
+	case Ast::Type::OrN:
+	case Ast::Type::XorN: {
+		auto& xs = static_cast<const Ast::Nary*>(x)->ops;
+		auto& ys = static_cast<const Ast::Nary*>(y)->ops;
+		if (xs.size() != ys.size())
+			return false;
+		for (size_t i = 0; i < xs.size(); ++i) {
+			if (!equals_at(xs[i].get(), ys[i].get(), depth + 1))
+				return false;
+		}
+		return true;
+	}
+	default: {
+		auto bx = static_cast<const Ast::Binary*>(x);
+		auto by = static_cast<const Ast::Binary*>(y);
+		return equals_at(bx->lhs.get(), by->lhs.get(), depth + 1) &&
+			equals_at(bx->rhs.get(), by->rhs.get(), depth + 1);
+	}
+	}
 }
 
-string Ast::And::to_prefix(void) const {
-	return "& " + lhs->to_prefix() + " " + rhs->to_prefix();
+bool Ast::equals_structure(const Ast& b) const {
+	return equals_at(this, &b, 0);
 }
 
-string Ast::And::to_postfix(void) const {
-	return lhs->to_postfix() + " " + rhs->to_postfix() + " &";
+bool Ast::eval_iterative(const Assignment& assign) const {
+	/* Skip the remaining operands once the value is known. */
+	auto cut = [] (const Ast* node, const char* v, size_t i) {
+		switch (node->type()) {
+		case Ast::Type::And:
+		case Ast::Type::AndN:
+			return !v[i - 1];
+		case Ast::Type::Or:
+		case Ast::Type::OrN:
+			return !!v[i - 1];
+		case Ast::Type::Impl:
+			return !v[0];
+		default:
+			return false;
+		}
+	};
+
+	/* With short-circuiting, the value of a conjunction or disjunction
+	 * is that of the last operand evaluated. */
+	auto visit = [&] (const Ast* node, const char* v, size_t n) -> char {
+		switch (node->type()) {
+		case Ast::Type::Const: return static_cast<const Ast::Const*>(node)->value;
+		case Ast::Type::Var:   return assign[static_cast<const Ast::Var*>(node)->var];
+		case Ast::Type::Not:   return !v[0];
+		case Ast::Type::And:
+		case Ast::Type::AndN:
+		case Ast::Type::Or:
+		case Ast::Type::OrN:   return n && v[n - 1];
+		case Ast::Type::Impl:  return n == 1 || v[1];
+		case Ast::Type::Eqv:   return v[0] == v[1];
+		case Ast::Type::Xor:   return v[0] != v[1];
+		case Ast::Type::XorN: {
+			bool p = false;
+			for (size_t i = 0; i < n; ++i)
+				p ^= v[i];
+			return p;
+		}
+		}
+		return false;
+	};
+
+	/* Evaluation does not nest, so the stacks can be reused. */
+	static thread_local PostOrder<char> walk;
+	return walk.run(this, visit, PostOrder<char>::Descend(), cut);
 }
 
-/*
- * Ast::Or
- */
+const Ast::Ref& Ast::constant(bool value) {
+	static const Ast::Ref constants[2] = {
+		Ast::make<Ast::Const>(false),
+		Ast::make<Ast::Const>(true),
+	};
+	return constants[value];
+}
 
-shared_ptr<Ast> Ast::Or::simplify(const Assignment& assign) const {
-	auto newlhs = lhs->simplify(assign);
-	auto newrhs = rhs->simplify(assign);
-	if (newlhs->type() == Ast::Type::Const) {
-		return static_cast<Ast::Const*>(newlhs.get())->value
-			? make_shared<Ast::Const>(true) : newrhs;
-	}
-	if (newrhs->type() == Ast::Type::Const) {
-		return static_cast<Ast::Const*>(newrhs.get())->value
-			? make_shared<Ast::Const>(true) : newlhs;
+/* The negation of a simplified subtree. */
+static Ast::Ref negate(const Ast::Ref& a) {
+	/* Remove double negations */
+	if (a->type() == Ast::Type::Not)
+		return static_cast<Ast::Not*>(a.get())->rhs;
+	/* Reduce Not Const */
+	if (a->type() == Ast::Type::Const)
+		return Ast::constant(not static_cast<Ast::Const*>(a.get())->value);
+	return Ast::make<Ast::Not>(a);
+}
+
+/* A simplified n-ary node from the simplified operands, see simplify. */
+static Ast::Ref simplify_nary(const Ast* node, const Ast::Ref* res, size_t n) {
+	auto op = [&] (size_t i) -> const Ast::Ref& { return res[i] ? res[i] : node->operand(i); };
+	size_t i = 0;
+	while (i < n && !res[i] && op(i)->type() != Ast::Type::Const)
+		++i;
+	if (i == n)
+		return nullptr;
+
+	/* The identity of the connective, and for And and Or the value
+	 * which absorbs it. */
+	const Ast::Type type = node->type();
+	const bool unit = type == Ast::Type::AndN;
+	vector<Ast::Ref> newops;
+	bool parity = false;
+	for (size_t i = 0; i < n; ++i) {
+		if (op(i)->type() != Ast::Type::Const) {
+			newops.push_back(op(i));
+			continue;
+		}
+		const bool value = static_cast<Ast::Const*>(op(i).get())->value;
+		if (type == Ast::Type::XorN)
+			parity ^= value;
+		else if (value != unit)
+			return Ast::constant(value);
 	}
-	return make_shared<Ast::Or>(newlhs, newrhs);
+	if (newops.size() == 0)
+		return Ast::constant(type == Ast::Type::XorN ? parity : unit);
+
+	Ast::Ref out;
+	if (newops.size() == 1)
+		out = newops.front();
+	else if (type == Ast::Type::AndN)
+		out = Ast::make<Ast::AndN>(move(newops));
+	else if (type == Ast::Type::OrN)
+		out = Ast::make<Ast::OrN>(move(newops));
+	else
+		out = Ast::make<Ast::XorN>(move(newops));
+	return parity ? negate(out) : out;
 }
 
-string Ast::Or::to_infix(void) const {
-	return _to_infix("|", lhs.get(), this, rhs.get());
+Ast::Ref Ast::simplify(const Ast::Ref& root, const Assignment& assign) {
+	/* The result of a node is null if it is unchanged. That is the case
+	 * if none of its operands changed and none of them is a constant. */
+	auto visit = [&] (const Ast* node, const Ast::Ref* res, size_t n) -> Ast::Ref {
+		auto op       = [&] (size_t i) -> const Ast::Ref& { return res[i] ? res[i] : node->operand(i); };
+		auto is_const = [&] (size_t i) { return op(i)->type() == Ast::Type::Const; };
+		auto value    = [&] (size_t i) { return static_cast<Ast::Const*>(op(i).get())->value; };
+		auto changed  = [&] (void) { return res[0] || res[1]; };
+		switch (node->type()) {
+		case Ast::Type::Const:
+			return nullptr;
+
+		case Ast::Type::Var: {
+			size_t i = assign.position(static_cast<const Ast::Var*>(node)->var);
+			if (i != Assignment::npos)
+				return Ast::constant(assign.value(i));
+			return nullptr;
+		}
+
+		case Ast::Type::Not:
+			if (!res[0] && !is_const(0) && op(0)->type() != Ast::Type::Not)
+				return nullptr;
+			return negate(op(0));
+
+		case Ast::Type::And:
+			if (is_const(0))
+				return value(0) ? op(1) : Ast::constant(false);
+			if (is_const(1))
+				return value(1) ? op(0) : Ast::constant(false);
+			return changed() ? Ast::make<Ast::And>(op(0), op(1)) : nullptr;
+
+		case Ast::Type::Or:
+			if (is_const(0))
+				return value(0) ? Ast::constant(true) : op(1);
+			if (is_const(1))
+				return value(1) ? Ast::constant(true) : op(0);
+			return changed() ? Ast::make<Ast::Or>(op(0), op(1)) : nullptr;
+
+		case Ast::Type::Impl:
+			if (is_const(0))
+				return value(0) ? op(1) : Ast::constant(true);
+			if (is_const(1))
+				return value(1) ? Ast::constant(true) : negate(op(0));
+			return changed() ? Ast::make<Ast::Impl>(op(0), op(1)) : nullptr;
+
+		case Ast::Type::Eqv:
+			if (is_const(0))
+				return value(0) ? op(1) : negate(op(1));
+			if (is_const(1))
+				return value(1) ? op(0) : negate(op(0));
+			return changed() ? Ast::make<Ast::Eqv>(op(0), op(1)) : nullptr;
+
+		case Ast::Type::Xor:
+			if (is_const(0))
+				return value(0) ? negate(op(1)) : op(1);
+			if (is_const(1))
+				return value(1) ? negate(op(0)) : op(0);
+			return changed() ? Ast::make<Ast::Xor>(op(0), op(1)) : nullptr;
+
+		case Ast::Type::AndN:
+		case Ast::Type::OrN:
+		case Ast::Type::XorN:
+			return simplify_nary(node, res, n);
+		}
+		return nullptr;
+	};
+
+	/* Simplification does not nest, so the stacks can be reused. */
+	static thread_local PostOrder<Ast::Ref> walk;
+	auto out = walk.run(root.get(), visit);
+	return out ? out : root;
 }
 
-string Ast::Or::to_prefix(void) const {
-	return "| " + lhs->to_prefix() + " " + rhs->to_prefix();
+static const char* symbol(Ast::Type type) {
+	switch (type) {
+	case Ast::Type::Not:  return "~";
+	case Ast::Type::And:
+	case Ast::Type::AndN: return "&";
+	case Ast::Type::Or:
+	case Ast::Type::OrN:  return "|";
+	case Ast::Type::Impl: return ">";
+	case Ast::Type::Eqv:  return "=";
+	case Ast::Type::Xor:
+	case Ast::Type::XorN: return "^";
+	default:              return "";
+	}
 }
 
-string Ast::Or::to_postfix(void) const {
-	return lhs->to_postfix() + " " + rhs->to_postfix() + " |";
+/* Appends to a caller's string. */
+struct StringSink {
+	string& out;
+
+	void put(char c)             { out += c; }
+	void put(const char* s)      { out += s; }
+	void put(const string& s)    { out += s; }
+};
+
+/* Writes to a stream through a buffer, so that a long formula is not
+ * written character by character. */
+struct StreamSink {
+	ostream& os;
+	string buffer;
+	static constexpr size_t CHUNK = 1 << 16;
+
+	StreamSink(ostream& os) : os(os) { buffer.reserve(CHUNK); }
+	~StreamSink(void) { os.write(buffer.data(), buffer.size()); }
+
+	void flush(void) {
+		if (buffer.size() >= CHUNK) {
+			os.write(buffer.data(), buffer.size());
+			buffer.clear();
+		}
+	}
+
+	void put(char c)             { buffer += c; flush(); }
+	void put(const char* s)      { buffer += s; flush(); }
+	void put(const string& s)    { buffer += s; flush(); }
+};
+
+/* Constants and variables are written the same in every notation. */
+template<typename Sink>
+static void put_atom(Sink& out, const Ast* node) {
+	if (node->type() == Ast::Type::Const)
+		out.put(static_cast<const Ast::Const*>(node)->value ? "\\T" : "\\F");
+	else
+		out.put(static_cast<const Ast::Var*>(node)->var->to_string());
 }
 
 /*
- * Ast::Impl
+ * Walk the subtree depth-first on an explicit stack, so that the text
+ * can be written in order, in one pass. `open(node, parent)` is called
+ * when a node is entered, `between(node, i)` before its operand i > 0
+ * and `close(node, parent)` when all of its operands are done. For the
+ * root, `parent` is null.
  */
-
-shared_ptr<Ast> Ast::Impl::simplify(const Assignment& assign) const {
-	auto newlhs = lhs->simplify(assign);
-	auto newrhs = rhs->simplify(assign);
-	if (newlhs->type() == Ast::Type::Const) {
-		return static_cast<Ast::Const*>(newlhs.get())->value
-			? newrhs : make_shared<Ast::Const>(true);
+template<typename Open, typename Between, typename Close>
+static void walk_text(const Ast* root, Open&& open, Between&& between, Close&& close) {
+	struct Frame {
+		const Ast* node;
+		size_t next;
+	};
+	vector<Frame> stack;
+
+	open(root, nullptr);
+	if (!root->arity()) {
+		close(root, nullptr);
+		return;
 	}
-	if (newrhs->type() == Ast::Type::Const) {
-		return static_cast<Ast::Const*>(newrhs.get())->value
-			? make_shared<Ast::Const>(true)
-			: Ast::Not(newlhs).simplify(assign);
+	stack.push_back(Frame{ root, 0 });
+	while (!stack.empty()) {
+		Frame& f = stack.back();
+		const Ast* node = f.node;
+		if (f.next == node->arity()) {
+			stack.pop_back();
+			close(node, stack.empty() ? nullptr : stack.back().node);
+			continue;
+		}
+
+		const size_t i = f.next++;
+		if (i)
+			between(node, i);
+		const Ast* op = node->operand(i).get();
+		open(op, node);
+		if (op->arity())
+			stack.push_back(Frame{ op, 0 });
+		else
+			close(op, node);
 	}
-	return make_shared<Ast::Impl>(newlhs, newrhs);
 }
 
-string Ast::Impl::to_infix(void) const {
-	return _to_infix(">", lhs.get(), this, rhs.get());
+/* An operand is put in parentheses if it binds weaker than its parent. */
+static inline bool paren(const Ast* node, const Ast* parent) {
+	return parent && node->prec() < parent->prec();
 }
 
-string Ast::Impl::to_prefix(void) const {
-	return "> " + lhs->to_prefix() + " " + rhs->to_prefix();
+template<typename Sink>
+static void write_infix(const Ast* root, Sink& out) {
+	walk_text(root,
+		[&] (const Ast* node, const Ast* parent) {
+			if (paren(node, parent))
+				out.put('(');
+			if (!node->arity())
+				put_atom(out, node);
+			else if (node->type() == Ast::Type::Not)
+				out.put('~');
+		},
+		[&] (const Ast* node, size_t) {
+			out.put(' ');
+			out.put(symbol(node->type()));
+			out.put(' ');
+		},
+		[&] (const Ast* node, const Ast* parent) {
+			if (paren(node, parent))
+				out.put(')');
+		});
 }
 
-string Ast::Impl::to_postfix(void) const {
-	return lhs->to_postfix() + " " + rhs->to_postfix() + " >";
+/* N-ary nodes are written like the right-nested chain of binary ones. */
+template<typename Sink>
+static void write_prefix(const Ast* root, Sink& out) {
+	walk_text(root,
+		[&] (const Ast* node, const Ast*) {
+			if (!node->arity()) {
+				put_atom(out, node);
+				return;
+			}
+			out.put(symbol(node->type()));
+			out.put(' ');
+		},
+		[&] (const Ast* node, size_t i) {
+			out.put(' ');
+			if (i + 1 < node->arity()) {
+				out.put(symbol(node->type()));
+				out.put(' ');
+			}
+		},
+		[] (const Ast*, const Ast*) { });
 }
 
-/*
- * Ast::Eqv
- */
+template<typename Sink>
+static void write_postfix(const Ast* root, Sink& out) {
+	bool first = true;
+	walk_text(root,
+		[] (const Ast*, const Ast*) { },
+		[] (const Ast*, size_t) { },
+		[&] (const Ast* node, const Ast*) {
+			if (!first)
+				out.put(' ');
+			first = false;
+			const size_t n = node->arity();
+			if (n == 0) {
+				put_atom(out, node);
+				return;
+			}
+			const char* sym = symbol(node->type());
+			out.put(sym);
+			for (size_t i = 2; i < n; ++i) {
+				out.put(' ');
+				out.put(sym);
+			}
+		});
+}
 
-shared_ptr<Ast> Ast::Eqv::simplify(const Assignment& assign) const {
-	auto newlhs = lhs->simplify(assign);
-	auto newrhs = rhs->simplify(assign);
-	if (newlhs->type() == Ast::Type::Const) {
-		return static_cast<Ast::Const*>(newlhs.get())->value
-			? newrhs : Ast::Not(newrhs).simplify(assign);
-	}
-	if (newrhs->type() == Ast::Type::Const) {
-		return static_cast<Ast::Const*>(newrhs.get())->value
-			? newlhs : Ast::Not(newlhs).simplify(assign);
-	}
-	return make_shared<Ast::Eqv>(newlhs, newrhs);
+void Ast::write_infix(string& out) const {
+	StringSink sink{out};
+	Propcalc::write_infix(this, sink);
+}
+
+void Ast::write_infix(ostream& os) const {
+	StreamSink sink(os);
+	Propcalc::write_infix(this, sink);
 }
 
-string Ast::Eqv::to_infix(void) const {
-	return _to_infix("=", lhs.get(), this, rhs.get());
+void Ast::write_prefix(string& out) const {
+	StringSink sink{out};
+	Propcalc::write_prefix(this, sink);
 }
 
-string Ast::Eqv::to_prefix(void) const {
-	return "= " + lhs->to_prefix() + " " + rhs->to_prefix();
+void Ast::write_prefix(ostream& os) const {
+	StreamSink sink(os);
+	Propcalc::write_prefix(this, sink);
 }
 
-string Ast::Eqv::to_postfix(void) const {
-	return lhs->to_postfix() + " " + rhs->to_postfix() + " =";
+void Ast::write_postfix(string& out) const {
+	StringSink sink{out};
+	Propcalc::write_postfix(this, sink);
+}
+
+void Ast::write_postfix(ostream& os) const {
+	StreamSink sink(os);
+	Propcalc::write_postfix(this, sink);
 }
 
 /*
- * Ast::Xor
+ * Ast::flatten
  */
 
-shared_ptr<Ast> Ast::Xor::simplify(const Assignment& assign) const {
-	auto newlhs = lhs->simplify(assign);
-	auto newrhs = rhs->simplify(assign);
-	if (newlhs->type() == Ast::Type::Const) {
-		return static_cast<Ast::Const*>(newlhs.get())->value
-			? Ast::Not(newrhs).simplify(assign) : newrhs;
-	}
-	if (newrhs->type() == Ast::Type::Const) {
-		return static_cast<Ast::Const*>(newrhs.get())->value
-			? Ast::Not(newlhs).simplify(assign) : newlhs;
+/* The n-ary connective whose chains contain nodes of this type, or Const if none. */
+static Ast::Type family(Ast::Type type) {
+	switch (type) {
+	case Ast::Type::And:
+	case Ast::Type::AndN:
+		return Ast::Type::AndN;
+	case Ast::Type::Or:
+	case Ast::Type::OrN:
+		return Ast::Type::OrN;
+	case Ast::Type::Xor:
+	case Ast::Type::XorN:
+		return Ast::Type::XorN;
+	default:
+		return Ast::Type::Const;
 	}
-	return make_shared<Ast::Xor>(newlhs, newrhs);
 }
 
-string Ast::Xor::to_infix(void) const {
-	return _to_infix("^", lhs.get(), this, rhs.get());
+/* The operands of a node from left to right. */
+static vector<Ast::Ref> operands(const Ast* node) {
+	vector<Ast::Ref> ops;
+	for (size_t i = 0; i < node->arity(); ++i)
+		ops.push_back(node->operand(i));
+	return ops;
 }
 
-string Ast::Xor::to_prefix(void) const {
-	return "^ " + lhs->to_prefix() + " " + rhs->to_prefix();
+/* The maximal subtrees below `node` which are not in its chain, from left to right. */
+static vector<Ast::Ref> chain(const Ast* node) {
+	const auto fam = family(node->type());
+	vector<Ast::Ref> ops;
+	stack<Ast::Ref> todo;
+	auto push = [&] (const Ast* n) {
+		auto children = operands(n);
+		for (auto it = children.rbegin(); it != children.rend(); ++it)
+			todo.push(*it);
+	};
+	push(node);
+	while (!todo.empty()) {
+		auto op = todo.top();
+		todo.pop();
+		if (family(op->type()) == fam)
+			push(op.get());
+		else
+			ops.push_back(op);
+	}
+	return ops;
 }
 
-string Ast::Xor::to_postfix(void) const {
-	return lhs->to_postfix() + " " + rhs->to_postfix() + " ^";
+Ast::Ref Ast::flatten(const Ast::Ref& root) {
+	/* Iterative post-order traversal. A node is pushed first to
+	 * schedule its operands, which are those of its whole chain for
+	 * the associative connectives, and again to rebuild it. */
+	unordered_map<const Ast*, Ast::Ref> done;
+	unordered_map<const Ast*, vector<Ast::Ref>> pending;
+	stack<pair<Ast::Ref, bool>> todo;
+	todo.push({ root, false });
+	while (!todo.empty()) {
+		auto [node, expanded] = todo.top();
+		todo.pop();
+		if (done.count(node.get()))
+			continue;
+
+		if (!expanded) {
+			auto ops = family(node->type()) != Ast::Type::Const ?
+				chain(node.get()) : operands(node.get());
+			if (ops.empty()) {
+				done.insert({ node.get(), node });
+				continue;
+			}
+			todo.push({ node, true });
+			for (auto it = ops.rbegin(); it != ops.rend(); ++it)
+				todo.push({ *it, false });
+			pending.insert({ node.get(), move(ops) });
+			continue;
+		}
+
+		auto ops = move(pending.at(node.get()));
+		pending.erase(node.get());
+		bool changed = false;
+		for (auto& op : ops) {
+			auto& newop = done.at(op.get());
+			changed |= newop != op;
+			op = newop;
+		}
+
+		Ast::Ref res = node;
+		switch (node->type()) {
+		case Ast::Type::Not:
+			if (changed)
+				res = Ast::make<Ast::Not>(ops[0]);
+			break;
+		case Ast::Type::Impl:
+			if (changed)
+				res = Ast::make<Ast::Impl>(ops[0], ops[1]);
+			break;
+		case Ast::Type::Eqv:
+			if (changed)
+				res = Ast::make<Ast::Eqv>(ops[0], ops[1]);
+			break;
+		case Ast::Type::And:
+		case Ast::Type::AndN:
+			res = Ast::make<Ast::AndN>(move(ops));
+			break;
+		case Ast::Type::Or:
+		case Ast::Type::OrN:
+			res = Ast::make<Ast::OrN>(move(ops));
+			break;
+		case Ast::Type::Xor:
+		case Ast::Type::XorN:
+			res = Ast::make<Ast::XorN>(move(ops));
+			break;
+		default:
+			break;
+		}
+		done.insert({ node.get(), res });
+	}
+	return done.at(root.get());
 }
 
 } /* namespace Propcalc */
@@ -0,0 +1,72 @@
+/*
+ * bittable.cpp - Bittable, truth table as a packed bit vector
+ *
+ * Copyright (C) 2020 Tobias Boege
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the Artistic License 2.0
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ */
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <propcalc/bittable.hpp>
+#include <propcalc/formula.hpp>
+#include <propcalc/compiled.hpp>
+
+using namespace std;
+
+namespace Propcalc {
+
+Bittable::Bittable(const Formula& fm) : order(fm.vars()) {
+	const size_t n = order.size();
+	if (n >= 64)
+		throw length_error("Bittable needs fewer than 64 variables");
+	rows = uint64_t(1) << n;
+
+	CompiledFormula cf(fm);
+	if (rows < 64) {
+		/* eval_rows repeats the table; keep only its first period. */
+		bits.resize(1);
+		cf.eval_rows(0, bits.data(), 1);
+		bits[0] &= (uint64_t(1) << rows) - 1;
+		return;
+	}
+
+	/* Both the number of words and the native width are powers of two,
+	 * so the chunks are a multiple of the native width unless the whole
+	 * table is smaller than it. */
+	const uint64_t nwords = rows / 64;
+	const uint64_t chunk = min<uint64_t>(nwords, 64 * CompiledFormula::native_words());
+	bits.resize(nwords);
+	for (uint64_t k = 0; k < nwords; k += chunk)
+		cf.eval_rows(64 * k, &bits[k], chunk);
+}
+
+uint64_t Bittable::count(void) const {
+	uint64_t c = 0;
+	for (auto w : bits)
+		c += __builtin_popcountll(w);
+	return c;
+}
+
+uint64_t Bittable::next(uint64_t r) const {
+	if (r >= rows)
+		return rows;
+	size_t k = r / 64;
+	/* Mask off the bits before r in its word, then skip empty words. */
+	uint64_t w = bits[k] & (~uint64_t(0) << (r % 64));
+	while (!w) {
+		if (++k >= bits.size())
+			return rows;
+		w = bits[k];
+	}
+	return 64 * k + __builtin_ctzll(w);
+}
+
+} /* namespace Propcalc */
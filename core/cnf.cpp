@@ -12,46 +12,185 @@
  * Artistic License 2.0 for more details.
  */
 
+#include <stack>
+#include <unordered_map>
+#include <unordered_set>
+
 #include <propcalc/cnf.hpp>
+#include <propcalc/minimize.hpp>
 
 using namespace std;
 
 namespace Propcalc {
 
-CNF::CNF(const Formula& fm) : fm(fm) {
+CNF::CNF(const Formula& fm, bool caching, bool minimize) :
+	fm(fm), minimize(minimize)
+{
+	is_caching() = caching;
+
+	for (auto& ast : conjuncts(fm))
+		queue.push(ast);
+	++*this; /* forward to the first clause */
+}
+
+vector<Ast::Ref> CNF::conjuncts(const Formula& fm) {
 	/* Skip all And nodes at the root, recursively. These just
 	 * tell us to concatenate the clauses of the maximal subtrees
 	 * without an And at the root. This way, the truthtables
 	 * of subtrees are smaller. */
-	queue.push(fm.root);
-	while (queue.front()->type() == Ast::Type::And) {
-		Ast::And* v = static_cast<Ast::And*>(queue.front().get());
-		queue.pop();
-		queue.push(v->lhs);
-		queue.push(v->rhs);
+	vector<Ast::Ref> subtrees;
+	stack<Ast::Ref> todo;
+	todo.push(fm.root);
+	while (!todo.empty()) {
+		auto ast = todo.top();
+		todo.pop();
+		if (ast->type() == Ast::Type::And) {
+			Ast::And* v = static_cast<Ast::And*>(ast.get());
+			todo.push(v->rhs);
+			todo.push(v->lhs);
+		}
+		else if (ast->type() == Ast::Type::AndN) {
+			auto& ops = static_cast<Ast::AndN*>(ast.get())->ops;
+			for (auto it = ops.rbegin(); it != ops.rend(); ++it)
+				todo.push(*it);
+		}
+		else {
+			subtrees.push_back(ast);
+		}
 	}
-	++*this; /* forward to the first clause */
+	return subtrees;
+}
+
+/**
+ * If the formula is a disjunction of literals and constants, collect its
+ * literals into `lits` and return true. `taut` is set if the disjunction
+ * is a tautology, because it contains true or a complementary pair of
+ * literals. Returns false if the formula is of any other form.
+ */
+static bool collect_literals(const Ast::Ref& ast, unordered_map<VarRef, bool>& lits, bool& taut) {
+	stack<Ast*> todo;
+	todo.push(ast.get());
+	while (!todo.empty()) {
+		Ast* node = todo.top();
+		todo.pop();
+
+		VarRef var;
+		bool sign = true;
+		switch (node->type()) {
+			case Ast::Type::Or: {
+				auto v = static_cast<Ast::Or*>(node);
+				todo.push(v->rhs.get());
+				todo.push(v->lhs.get());
+				continue;
+			}
+
+			case Ast::Type::OrN: {
+				auto& ops = static_cast<Ast::OrN*>(node)->ops;
+				for (auto it = ops.rbegin(); it != ops.rend(); ++it)
+					todo.push(it->get());
+				continue;
+			}
+
+			case Ast::Type::Const:
+				taut |= static_cast<Ast::Const*>(node)->value;
+				continue;
+
+			case Ast::Type::Var:
+				var = static_cast<Ast::Var*>(node)->var;
+				break;
+
+			case Ast::Type::Not: {
+				auto rhs = static_cast<Ast::Not*>(node)->rhs.get();
+				if (rhs->type() != Ast::Type::Var)
+					return false;
+				var = static_cast<Ast::Var*>(rhs)->var;
+				sign = false;
+				break;
+			}
+
+			default:
+				return false;
+		}
+
+		auto [it, fresh] = lits.insert({ var, sign });
+		taut |= !fresh && it->second != sign;
+	}
+	return true;
 }
 
 CNF& CNF::operator++(void) {
+	if (finished) {
+		current = nullptr;
+		finished = false;
+	}
 	while (true) {
+		/* Clauses of a minimized conjunct */
+		if (!pending.empty()) {
+			pending.pop(value);
+			produced();
+			finished = pending.empty();
+			break;
+		}
+
 		if (!current) {
 			if (queue.size() == 0)
 				break; /* no more clauses */
 			current = queue.front();
 			queue.pop();
-			last = Assignment(Formula(current, fm.domain).vars());
+
+			/* Emit clauses directly, skipping tautologies and repeats. */
+			unordered_map<VarRef, bool> lits;
+			bool taut = false;
+			if (collect_literals(current, lits, taut)) {
+				if (taut) {
+					current = nullptr;
+					continue;
+				}
+				unordered_set<VarRef> pile;
+				for (auto& [v, sign] : lits)
+					pile.insert(v);
+				Clause cl;
+				for (auto v : fm.domain->sort(pile))
+					cl[v] = lits.at(v);
+				if (!emitted.insert({ cl.vars(), cl.words() }).second) {
+					current = nullptr;
+					continue;
+				}
+				/* Keep `current` until the next step, so that the
+				 * stream does not end before this clause is read. */
+				finished = true;
+				produce(cl);
+				break;
+			}
+
+			Formula sub(current, fm.domain);
+			if (minimize && sub.vars().size() <= Minimize::MAX_VARS) {
+				for (auto& cl : Minimize::cnf(sub.truthtable_bits()))
+					pending.push(cl);
+				if (pending.empty())
+					current = nullptr;
+				continue;
+			}
+
+			last = sub.assignment();
+			incr.emplace(make_shared<CompiledFormula>(sub));
+			row = 0;
+			stop = last.vars().size() < 64 ? uint64_t(1) << last.vars().size() : UINT64_MAX;
 		}
 		else {
-			++last;
-			if (last.overflown()) {
+			/* Step to the next assignment in Gray code order. */
+			if (++row >= stop) {
 				current = nullptr;
 				continue;
 			}
+			unsigned int i = __builtin_ctzll(row);
+			last.flip(i);
+			incr->flip(i);
 		}
 
-		if (!current->eval(last)) {
-			produce(~last);
+		if (!incr->value()) {
+			value.forbid(last);
+			produced();
 			break; /* found the next clause */
 		}
 	}
@@ -0,0 +1,326 @@
+/*
+ * compiled.cpp - CompiledFormula, flat representation for evaluation
+ *
+ * Copyright (C) 2020 Tobias Boege
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the Artistic License 2.0
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ */
+
+#include <cstring>
+#include <algorithm>
+
+#include <stack>
+#include <unordered_map>
+
+#include <propcalc/formula.hpp>
+#include <propcalc/compiled.hpp>
+
+using namespace std;
+
+/* The wide bit-sliced kernels use GCC vector extensions and are compiled
+ * for AVX2 and AVX-512 using target attributes. Which one is used is
+ * decided at runtime. Other platforms only get the 64-bit kernel. */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define PROPCALC_X86_DISPATCH
+#endif
+
+namespace Propcalc {
+
+#ifdef PROPCALC_X86_DISPATCH
+typedef uint64_t v4u64 __attribute__((vector_size(32), may_alias));
+typedef uint64_t v8u64 __attribute__((vector_size(64), may_alias));
+#endif
+
+/* Return the operands of a node, rhs only for unary ones. */
+static pair<const Ast*, const Ast*> operands(const Ast* node) {
+	switch (node->type()) {
+	case Ast::Type::Not:
+		return { static_cast<const Ast::Not*>(node)->rhs.get(), nullptr };
+	case Ast::Type::And:
+		return { static_cast<const Ast::And*>(node)->lhs.get(), static_cast<const Ast::And*>(node)->rhs.get() };
+	case Ast::Type::Or:
+		return { static_cast<const Ast::Or*>(node)->lhs.get(), static_cast<const Ast::Or*>(node)->rhs.get() };
+	case Ast::Type::Impl:
+		return { static_cast<const Ast::Impl*>(node)->lhs.get(), static_cast<const Ast::Impl*>(node)->rhs.get() };
+	case Ast::Type::Eqv:
+		return { static_cast<const Ast::Eqv*>(node)->lhs.get(), static_cast<const Ast::Eqv*>(node)->rhs.get() };
+	case Ast::Type::Xor:
+		return { static_cast<const Ast::Xor*>(node)->lhs.get(), static_cast<const Ast::Xor*>(node)->rhs.get() };
+	default:
+		return { nullptr, nullptr };
+	}
+}
+
+/* Truth table of each connective as documented in CompiledFormula::Instr. */
+static unsigned char truth_table(Ast::Type op) {
+	switch (op) {
+	case Ast::Type::Var:  return 0x8;
+	case Ast::Type::Not:  return 0x1;
+	case Ast::Type::And:  return 0x8;
+	case Ast::Type::Or:   return 0xE;
+	case Ast::Type::Impl: return 0xB;
+	case Ast::Type::Eqv:  return 0x9;
+	case Ast::Type::Xor:  return 0x6;
+	default:              return 0x0;
+	}
+}
+
+CompiledFormula::CompiledFormula(const Formula& fm) : slots(fm.vars()) {
+	/* Map each node to its index in the value array. Variables
+	 * are the first entries. */
+	unordered_map<const Ast*, unsigned int> done;
+	unordered_map<VarRef, unsigned int> slotnr;
+	for (unsigned int i = 0; i < slots.size(); ++i)
+		slotnr.insert({ slots[i], i });
+
+	/* Iterative post-order traversal. Every node is pushed twice: first
+	 * to schedule its operands and then to emit its instruction once
+	 * the operands have been compiled. */
+	stack<pair<const Ast*, bool>> todo;
+	todo.push({ fm.root.get(), false });
+	while (!todo.empty()) {
+		auto [node, expanded] = todo.top();
+		todo.pop();
+		if (done.count(node))
+			continue;
+
+		if (node->type() == Ast::Type::Var) {
+			done.insert({ node, slotnr.at(static_cast<const Ast::Var*>(node)->var) });
+			continue;
+		}
+
+		/* An n-ary node becomes a chain of binary instructions. */
+		const auto type = node->type();
+		if (type == Ast::Type::AndN || type == Ast::Type::OrN || type == Ast::Type::XorN) {
+			auto nary = static_cast<const Ast::Nary*>(node);
+			if (!expanded) {
+				todo.push({ node, true });
+				for (auto it = nary->ops.rbegin(); it != nary->ops.rend(); ++it)
+					todo.push({ it->get(), false });
+				continue;
+			}
+
+			const auto op = nary->binary();
+			unsigned int acc = done.at(nary->ops[0].get());
+			for (size_t i = 1; i < nary->ops.size(); ++i) {
+				code.push_back(Instr{op, truth_table(op), acc, done.at(nary->ops[i].get())});
+				acc = slots.size() + code.size() - 1;
+			}
+			done.insert({ node, acc });
+			continue;
+		}
+
+		auto [lhs, rhs] = operands(node);
+		if (!expanded) {
+			todo.push({ node, true });
+			if (rhs)
+				todo.push({ rhs, false });
+			if (lhs)
+				todo.push({ lhs, false });
+			continue;
+		}
+
+		Instr in{node->type(), truth_table(node->type()), 0, 0};
+		if (node->type() == Ast::Type::Const) {
+			in.table = static_cast<const Ast::Const*>(node)->value ? 0xF : 0x0;
+		}
+		else {
+			in.a = done.at(lhs);
+			in.b = rhs ? done.at(rhs) : in.a;
+		}
+		done.insert({ node, slots.size() + code.size() });
+		code.push_back(in);
+	}
+
+	/* A sole variable needs an instruction to copy it. */
+	if (fm.root->type() == Ast::Type::Var) {
+		unsigned int a = done.at(fm.root.get());
+		code.push_back(Instr{Ast::Type::Var, truth_table(Ast::Type::Var), a, a});
+	}
+}
+
+bool CompiledFormula::eval(const vector<bool>& bits) const {
+	/* Scratch space for the value array. It is kept per thread
+	 * to avoid an allocation per evaluation. */
+	const size_t n = slots.size();
+	const size_t m = n + code.size();
+	thread_local vector<unsigned char> scratch;
+	if (scratch.size() < m)
+		scratch.resize(m);
+
+	/* Work on local pointers: stores through unsigned char may alias
+	 * anything, which would make the compiler reload the vectors. */
+	unsigned char* v = scratch.data();
+	const Instr* c = code.data();
+	for (size_t i = 0; i < n; ++i)
+		v[i] = bits[i];
+	for (size_t i = n; i < m; ++i, ++c)
+		v[i] = (c->table >> (v[c->a] << 1 | v[c->b])) & 1;
+	return v[m - 1];
+}
+
+bool CompiledFormula::eval(const Assignment& assign) const {
+	vector<bool> bits(slots.size());
+	for (size_t i = 0; i < slots.size(); ++i)
+		bits[i] = assign[slots[i]];
+	return eval(bits);
+}
+
+/*
+ * Incremental evaluation
+ */
+
+CompiledFormula::Incremental::Incremental(shared_ptr<const CompiledFormula> cf) :
+	cf(cf), v(cf->slots.size() + cf->code.size())
+{
+	const size_t n = cf->slots.size();
+	const size_t m = n + cf->code.size();
+
+	/* Mark the dependents of each slot by one pass over the program per
+	 * slot. This takes O(n * m) time, and the cones together may have
+	 * that many entries, so it is meant for formulas with few variables. */
+	auto c = make_shared<vector<vector<unsigned int>>>(n);
+	vector<bool> dep(m);
+	for (size_t s = 0; s < n; ++s) {
+		fill(dep.begin(), dep.end(), false);
+		dep[s] = true;
+		for (size_t i = n; i < m; ++i) {
+			const Instr& in = cf->code[i - n];
+			if (in.op != Ast::Type::Const && (dep[in.a] || dep[in.b])) {
+				dep[i] = true;
+				(*c)[s].push_back(i - n);
+			}
+		}
+	}
+	cones = c;
+
+	for (unsigned int i = 0; i < cf->code.size(); ++i)
+		eval_instr(i);
+}
+
+/*
+ * Bit-sliced evaluation
+ */
+
+/* Evaluate `words` words of slices, sizeof(W) bytes at a time, in the
+ * scratch value array `v`. This is inlined into the wrappers below so
+ * that it is compiled for their respective target. */
+template<typename W>
+static inline __attribute__((always_inline))
+void sliced_kernel(const vector<CompiledFormula::Instr>& code, size_t n,
+		const uint64_t* slices, uint64_t* out, unsigned int words, W* v) {
+	constexpr unsigned int L = sizeof(W) / sizeof(uint64_t);
+	const size_t m = n + code.size();
+	const W ones = ~W{};
+	for (unsigned int k = 0; k < words; k += L) {
+		for (size_t i = 0; i < n; ++i)
+			memcpy(&v[i], &slices[i * words + k], sizeof(W));
+		const CompiledFormula::Instr* c = code.data();
+		for (size_t i = n; i < m; ++i, ++c) {
+			const W a = v[c->a];
+			const W b = v[c->b];
+			switch (c->op) {
+			case Ast::Type::Const: v[i] = c->table ? ones : W{}; break;
+			case Ast::Type::Var:   v[i] = a;                     break;
+			case Ast::Type::Not:   v[i] = ~a;                    break;
+			case Ast::Type::And:   v[i] = a & b;                 break;
+			case Ast::Type::Or:    v[i] = a | b;                 break;
+			case Ast::Type::Impl:  v[i] = ~a | b;                break;
+			case Ast::Type::Eqv:   v[i] = ~(a ^ b);              break;
+			case Ast::Type::Xor:   v[i] = a ^ b;                 break;
+			/* n-ary nodes are compiled to binary instructions */
+			case Ast::Type::AndN:
+			case Ast::Type::OrN:
+			case Ast::Type::XorN:  break;
+			}
+		}
+		memcpy(&out[k], &v[m - 1], sizeof(W));
+	}
+}
+
+/* Return a per-thread scratch area for `m` values of 64 bytes each. */
+static uint64_t* sliced_scratch(size_t m) {
+	thread_local vector<uint64_t> scratch;
+	if (scratch.size() < 8 * (m + 1))
+		scratch.resize(8 * (m + 1));
+	auto p = reinterpret_cast<uintptr_t>(scratch.data());
+	return reinterpret_cast<uint64_t*>((p + 63) & ~uintptr_t(63));
+}
+
+static void sliced_64(const vector<CompiledFormula::Instr>& code, size_t n,
+		const uint64_t* slices, uint64_t* out, unsigned int words) {
+	uint64_t* v = sliced_scratch(n + code.size());
+	sliced_kernel<uint64_t>(code, n, slices, out, words, v);
+}
+
+#ifdef PROPCALC_X86_DISPATCH
+__attribute__((target("avx2")))
+static void sliced_256(const vector<CompiledFormula::Instr>& code, size_t n,
+		const uint64_t* slices, uint64_t* out, unsigned int words) {
+	auto v = reinterpret_cast<v4u64*>(sliced_scratch(n + code.size()));
+	sliced_kernel<v4u64>(code, n, slices, out, words, v);
+}
+
+__attribute__((target("avx512f")))
+static void sliced_512(const vector<CompiledFormula::Instr>& code, size_t n,
+		const uint64_t* slices, uint64_t* out, unsigned int words) {
+	auto v = reinterpret_cast<v8u64*>(sliced_scratch(n + code.size()));
+	sliced_kernel<v8u64>(code, n, slices, out, words, v);
+}
+#endif
+
+unsigned int CompiledFormula::native_words(void) {
+#ifdef PROPCALC_X86_DISPATCH
+	static const unsigned int words =
+		__builtin_cpu_supports("avx512f") ? 8 :
+		__builtin_cpu_supports("avx2")    ? 4 : 1;
+	return words;
+#else
+	return 1;
+#endif
+}
+
+void CompiledFormula::eval_sliced(const uint64_t* slices, uint64_t* out, unsigned int words) const {
+#ifdef PROPCALC_X86_DISPATCH
+	unsigned int native = native_words();
+	if (native >= 8 && words % 8 == 0)
+		return sliced_512(code, slots.size(), slices, out, words);
+	if (native >= 4 && words % 4 == 0)
+		return sliced_256(code, slots.size(), slices, out, words);
+#endif
+	sliced_64(code, slots.size(), slices, out, words);
+}
+
+void CompiledFormula::eval_rows(uint64_t first, uint64_t* out, unsigned int words) const {
+	/* Within a word, the lowest six slots alternate in fixed patterns.
+	 * All higher slots are constant and given by the row number. */
+	static const uint64_t PATTERN[6] = {
+		0xAAAAAAAAAAAAAAAAULL, 0xCCCCCCCCCCCCCCCCULL, 0xF0F0F0F0F0F0F0F0ULL,
+		0xFF00FF00FF00FF00ULL, 0xFFFF0000FFFF0000ULL, 0xFFFFFFFF00000000ULL,
+	};
+
+	const size_t n = slots.size();
+	thread_local vector<uint64_t> slices;
+	if (slices.size() < n * words)
+		slices.resize(n * words);
+	for (size_t i = 0; i < n; ++i) {
+		for (unsigned int k = 0; k < words; ++k) {
+			uint64_t row = first + 64 * k;
+			if (i < 6)
+				slices[i * words + k] = PATTERN[i];
+			else if (i < 64)
+				slices[i * words + k] = (row >> i) & 1 ? ~0ULL : 0;
+			else
+				slices[i * words + k] = 0;
+		}
+	}
+	eval_sliced(slices.data(), out, words);
+}
+
+} /* namespace Propcalc */
@@ -14,6 +14,7 @@
 
 #include <memory>
 #include <mutex>
+#include <limits>
 
 #include <propcalc/domain.hpp>
 
@@ -33,74 +34,149 @@ pair<VarNr, VarRef> Cache::new_variable(string name) {
 	return put_variable(move(uvar));
 }
 
+/* The chunk of `by_nr` holding the variable with index i. */
+size_t Cache::chunk(size_t i) {
+	return 8 * sizeof(unsigned long) - 1 - __builtin_clzl(i / BASE + 1);
+}
+
+/* The slot of the variable with index i, which is VarNr i + 1. */
+VarRef& Cache::at(size_t i) const {
+	const size_t k = chunk(i);
+	return by_nr[k][i - BASE * ((size_t(1) << k) - 1)];
+}
+
+/* The named variable, or nullptr. This does not need the lock. */
+VarRef Cache::find(const string& name, size_t hash) const {
+	const Names* t = by_name.load(memory_order_acquire);
+	if (!t)
+		return nullptr;
+	for (size_t i = hash & t->mask; ; i = (i + 1) & t->mask) {
+		VarRef var = t->slots[i].var.load(memory_order_acquire);
+		if (!var)
+			return nullptr;
+		if (t->slots[i].hash == hash && var->name == name)
+			return var;
+	}
+}
+
 /* Needs the lock to be held! */
-pair<VarNr, VarRef> Cache::put_variable(unique_ptr<Variable> uvar) {
+void Cache::insert(VarRef var, size_t hash) {
+	auto put = [] (Names& t, VarRef var, size_t hash) {
+		size_t i = hash & t.mask;
+		while (t.slots[i].var.load(memory_order_relaxed))
+			i = (i + 1) & t.mask;
+		t.slots[i].hash = hash;
+		t.slots[i].var.store(var, memory_order_release);
+		t.used++;
+	};
+
+	/* Keep the table at most half full. A larger one is filled before
+	 * it is published, and the old one stays for current readers. */
+	Names* t = by_name.load(memory_order_relaxed);
+	if (!t || 2 * (t->used + 1) > t->mask + 1) {
+		auto bigger = make_unique<Names>(t ? 2 * (t->mask + 1) : 64);
+		if (t) {
+			for (size_t i = 0; i <= t->mask; ++i) {
+				VarRef v = t->slots[i].var.load(memory_order_relaxed);
+				if (v)
+					put(*bigger, v, t->slots[i].hash);
+			}
+		}
+		t = bigger.get();
+		tables.push_back(move(bigger));
+		put(*t, var, hash);
+		by_name.store(t, memory_order_release);
+		return;
+	}
+	put(*t, var, hash);
+}
+
+/* Needs the lock to be held! */
+pair<VarNr, VarRef> Cache::put_variable(unique_ptr<Variable> uvar, bool named) {
 	if (frozen)
 		throw X::Cache::Frozen();
-	VarRef var = uvar.get();
+	Variable* var = uvar.get();
+	const size_t i = cache.size();
+	if (i >= numeric_limits<VarNr>::max())
+		throw length_error("too many variables in the Cache");
+
+	/* VarNr are 1-based, so the index plus one is the right thing. */
+	VarNr nr = i + 1;
+	var->owner = this;
+	var->number = nr;
 	cache.push_back(move(uvar));
-	by_name.insert({ var->name, var });
-	by_nr.push_back(var);
-	/* VarNr are 1-based, so by_nr.size() after the
-	 * push_back() we just did is the right thing. */
-	VarNr nr = by_nr.size();
-	by_ref.insert({ var, nr });
+
+	const size_t k = chunk(i);
+	if (!by_nr[k])
+		by_nr[k].reset(new VarRef[BASE << k]);
+	at(i) = var;
+	/* Publish the variable by number, then by name. */
+	count.store(nr, memory_order_release);
+	if (named)
+		insert(var, hash<string>()(var->name));
 	return make_pair(nr, var);
 }
 
 VarRef Cache::resolve(std::string name) {
-	const std::lock_guard<std::mutex> lock(access);
+	const size_t h = hash<string>()(name);
+	VarRef var = find(name, h);
+	if (var)
+		return var;
 
-	VarRef var;
-	auto it = by_name.find(name);
-	if (it == by_name.end()) {
+	const std::lock_guard<std::mutex> lock(access);
+	/* Another thread may have created it in the meantime. */
+	var = find(name, h);
+	if (!var)
 		tie(ignore, var) = new_variable(name);
-	}
-	else {
-		var = it->second;
-	}
 	return var;
 }
 
+VarRef Cache::lookup(const std::string& name) {
+	return find(name, hash<string>()(name));
+}
+
 VarNr Cache::pack(VarRef var) {
-	const std::lock_guard<std::mutex> lock(access);
-	return by_ref[var];
+	return var->owner == this ? var->number : 0;
 }
 
 VarRef Cache::unpack(VarNr nr) {
-	const std::lock_guard<std::mutex> lock(access);
-
 	if (nr == 0)
 		throw X::Domain::InvalidVarNr();
+	if (nr <= count.load(memory_order_acquire))
+		return at(nr - 1);
 
+	const std::lock_guard<std::mutex> lock(access);
 	auto max = cache.size();
 	while (max < nr) {
 		tie(max, ignore) = new_variable(to_string(max + 1));
 	}
-	return by_nr[nr - 1];
+	return at(nr - 1);
 }
 
 vector<VarRef> Cache::list(void) const {
-	const std::lock_guard<std::mutex> lock(access);
-	return by_nr;
+	const size_t n = count.load(memory_order_acquire);
+	vector<VarRef> vars;
+	vars.reserve(n);
+	for (size_t i = 0; i < n; ++i)
+		vars.push_back(at(i));
+	return vars;
 }
 
 size_t Cache::size(void) const {
-	const std::lock_guard<std::mutex> lock(access);
-	return cache.size();
+	return count.load(memory_order_acquire);
 }
 
 /**
  * Slightly more efficient sorting than the default in Domain.
  */
 vector<VarRef> Cache::sort(unordered_set<VarRef>& pile) const {
-	const std::lock_guard<std::mutex> lock(access);
+	const size_t n = count.load(memory_order_acquire);
 	vector<VarRef> vec;
 
 	/* Amortized linear in domain size */
-	for (auto& v : by_nr) {
-		if (pile.count(v) > 0)
-			vec.push_back(v);
+	for (size_t i = 0; i < n; ++i) {
+		if (pile.count(at(i)) > 0)
+			vec.push_back(at(i));
 	}
 	return vec;
 }
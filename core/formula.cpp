@@ -24,6 +24,12 @@
 #include <propcalc/formula.hpp>
 #include <propcalc/truthtable.hpp>
 #include <propcalc/cnf.hpp>
+#include <propcalc/hybrid.hpp>
+#include <propcalc/compiled.hpp>
+#include <propcalc/bittable.hpp>
+#ifndef PROPCALC_SINGLE_THREADED
+#include <propcalc/parallel.hpp>
+#endif
 
 using namespace std;
 
@@ -218,8 +224,8 @@ static bool is_binary(const token& tok) {
  * push the AST node to that deque. Throws a Propcalc::X::Formula::Parser
  * exception if not enough operands are available.
  */
-static void reduce(token tok, deque<pair<shared_ptr<Ast>, token>>& astdq) {
-	shared_ptr<Ast> lhs, rhs;
+static void reduce(token tok, deque<pair<Ast::Ref, token>>& astdq) {
+	Ast::Ref lhs, rhs;
 
 	if (is_opening_paren(tok))
 		return;
@@ -235,22 +241,22 @@ static void reduce(token tok, deque<pair<shared_ptr<Ast>, token>>& astdq) {
 
 	switch (tok.op) {
 	case OP_NOT:
-		astdq.push_back({ make_shared<Ast::Not>(rhs), tok });
+		astdq.push_back({ Ast::make<Ast::Not>(rhs), tok });
 		break;
 	case OP_AND:
-		astdq.push_back({ make_shared<Ast::And>(lhs, rhs), tok });
+		astdq.push_back({ Ast::make<Ast::And>(lhs, rhs), tok });
 		break;
 	case OP_OR:
-		astdq.push_back({ make_shared<Ast::Or>(lhs, rhs), tok });
+		astdq.push_back({ Ast::make<Ast::Or>(lhs, rhs), tok });
 		break;
 	case OP_IMPL:
-		astdq.push_back({ make_shared<Ast::Impl>(lhs, rhs), tok });
+		astdq.push_back({ Ast::make<Ast::Impl>(lhs, rhs), tok });
 		break;
 	case OP_EQV:
-		astdq.push_back({ make_shared<Ast::Eqv>(lhs, rhs), tok });
+		astdq.push_back({ Ast::make<Ast::Eqv>(lhs, rhs), tok });
 		break;
 	case OP_XOR:
-		astdq.push_back({ make_shared<Ast::Xor>(lhs, rhs), tok });
+		astdq.push_back({ Ast::make<Ast::Xor>(lhs, rhs), tok });
 		break;
 	default:
 		throw X::Formula::Parser("Unrecognized operator", tok.offset);
@@ -261,8 +267,8 @@ static void reduce(token tok, deque<pair<shared_ptr<Ast>, token>>& astdq) {
  * Parse a given formula string into a root AST node for a Formula object,
  * resolving variables with the given `domain`.
  */
-shared_ptr<Ast> parse(const char* s, Domain* domain) {
-	deque<pair<shared_ptr<Ast>, token>> astdq;
+Ast::Ref parse(const char* s, Domain* domain) {
+	deque<pair<Ast::Ref, token>> astdq;
 	stack<token> ops;
 	expect next = EXPECT_TERM;
 	token tok;
@@ -296,18 +302,18 @@ shared_ptr<Ast> parse(const char* s, Domain* domain) {
 
 	unsigned int i = 0;
 	while (next_token(s, i, tok)) {
-		shared_ptr<Ast> ast;
+		Ast::Ref ast;
 
 		switch (tok.type) {
 		case TOK_CONST:
 			check_expect(EXPECT_TERM);
-			astdq.push_back({ make_shared<Ast::Const>(tok.val), tok });
+			astdq.push_back({ Ast::constant(!!tok.val), tok });
 			toggle_expect();
 			break;
 
 		case TOK_VAR:
 			check_expect(EXPECT_TERM);
-			astdq.push_back({ make_shared<Ast::Var>(
+			astdq.push_back({ Ast::make<Ast::Var>(
 				domain->resolve(string(tok.sym.s, tok.sym.len))
 			), tok });
 			toggle_expect();
@@ -393,24 +399,22 @@ Formula::Formula(const string& fm, Domain* domain) :
  * consists of a single Ast::Const node, which is false (false being the
  * identity element with respect to disjunction).
  */
-static shared_ptr<Ast> clause_ast(Clause& cl) {
-	vector<shared_ptr<Ast>> lits;
+static Ast::Ref clause_ast(Clause& cl) {
+	vector<Ast::Ref> lits;
 	for (auto& v : cl.vars()) {
-		shared_ptr<Ast> astsp = make_shared<Ast::Var>(v);
+		Ast::Ref astsp = Ast::make<Ast::Var>(v);
 		if (not cl[v])
-			astsp = make_shared<Ast::Not>(astsp);
+			astsp = Ast::make<Ast::Not>(astsp);
 		lits.push_back(astsp);
 	}
 
 	/* Empty clause is false (the identity of disjunction) */
 	if (lits.size() == 0)
-		return make_shared<Ast::Const>(false);
+		return Ast::constant(false);
 
-	auto astsp = lits.back();
-	lits.pop_back();
-	for (auto it = lits.rbegin(); it != lits.rend(); ++it)
-		astsp = make_shared<Ast::Or>(*it, astsp);
-	return astsp;
+	if (lits.size() == 1)
+		return lits.front();
+	return Ast::make<Ast::OrN>(move(lits));
 }
 
 Formula::Formula(Clause& cl, Domain* domain) :
@@ -422,31 +426,31 @@ Formula::Formula(Clause& cl, Domain* domain) :
 Formula::Formula(Conjunctive& clauses, Domain* domain) :
 		domain(domain)
 {
-	vector<shared_ptr<Ast>> cls;
+	vector<Ast::Ref> cls;
 	for (auto cl : clauses)
 		cls.push_back(clause_ast(cl));
 
 	/* Empty CNF is true (the identity of conjunction) */
 	if (cls.size() == 0) {
-		root = make_shared<Ast::Const>(true);
+		root = Ast::constant(true);
 		return;
 	}
 
-	auto astsp = cls.back();
-	cls.pop_back();
-	for (auto it = cls.rbegin(); it != cls.rend(); ++it)
-		astsp = make_shared<Ast::And>(*it, astsp);
-	root = astsp;
+	root = cls.size() == 1 ? cls.front() : Ast::make<Ast::AndN>(move(cls));
 }
 
 vector<VarRef> Formula::vars(void) const {
 	queue<Ast*> todo;
 	unordered_set<const Variable *> pile;
+	/* Shared subtrees are looked at once. */
+	unordered_set<const Ast*> seen;
 
 	todo.push(root.get());
 	while (!todo.empty()) {
 		Ast* node = todo.front();
 		todo.pop();
+		if (!seen.insert(node).second)
+			continue;
 
 		switch (node->type()) {
 			case Ast::Type::Const: {
@@ -493,61 +497,95 @@ vector<VarRef> Formula::vars(void) const {
 				todo.push(c->rhs.get());
 				break;
 			}
+			case Ast::Type::AndN:
+			case Ast::Type::OrN:
+			case Ast::Type::XorN: {
+				auto c = static_cast<Ast::Nary*>(node);
+				for (auto& op : c->ops)
+					todo.push(op.get());
+				break;
+			}
 		}
 	}
 	return domain->sort(pile);
 }
 
-Truthtable Formula::truthtable(bool caching) const {
-	Truthtable t(*this);
+Truthtable Formula::truthtable(bool caching, bool sliced) const {
+	Truthtable t(*this, sliced);
 	t.is_caching() = caching;
 	return t;
 }
 
-Tseitin Formula::tseitin(bool caching) const {
-	Tseitin t(*this);
+Truthtable Formula::truthtable_gray(bool caching) const {
+	Truthtable t(*this, false, true);
 	t.is_caching() = caching;
 	return t;
 }
 
-CNF Formula::cnf(bool caching) const {
-	CNF c(*this);
-	c.is_caching() = caching;
-	return c;
+Tseitin Formula::tseitin(bool caching, bool polarity) const {
+	return Tseitin(*this, caching, polarity);
+}
+
+Hybrid Formula::hybrid(uint64_t budget, bool caching) const {
+	return Hybrid(*this, budget, caching);
+}
+
+CNF Formula::cnf(bool caching, bool minimize) const {
+	return CNF(*this, caching, minimize);
+}
+
+#ifndef PROPCALC_SINGLE_THREADED
+ParallelCNF Formula::cnf_parallel(unsigned int threads, bool ordered, bool caching, bool minimize) const {
+	return ParallelCNF(*this, threads, ordered, caching, minimize);
+}
+#endif
+
+CompiledFormula Formula::compile(void) const {
+	return CompiledFormula(*this);
+}
+
+Bittable Formula::truthtable_bits(void) const {
+	return Bittable(*this);
+}
+
+#ifndef PROPCALC_SINGLE_THREADED
+ParallelTruthtable Formula::truthtable_parallel(unsigned int threads) const {
+	return ParallelTruthtable(*this, threads);
 }
+#endif
 
 Formula Formula::notf(void) const {
-	return Formula(make_shared<Ast::Not>(root), domain);
+	return Formula(Ast::make<Ast::Not>(root), domain);
 }
 
 Formula Formula::andf(const Formula& rhs) const {
 	if (domain != rhs.domain)
 		throw X::Formula::Connective(Ast::Type::And, domain, rhs.domain);
-	return Formula(make_shared<Ast::And>(root, rhs.root), domain);
+	return Formula(Ast::make<Ast::And>(root, rhs.root), domain);
 }
 
 Formula Formula::orf(const Formula& rhs) const {
 	if (domain != rhs.domain)
 		throw X::Formula::Connective(Ast::Type::Or, domain, rhs.domain);
-	return Formula(make_shared<Ast::Or>(root, rhs.root), domain);
+	return Formula(Ast::make<Ast::Or>(root, rhs.root), domain);
 }
 
 Formula Formula::thenf(const Formula& rhs) const {
 	if (domain != rhs.domain)
 		throw X::Formula::Connective(Ast::Type::Impl, domain, rhs.domain);
-	return Formula(make_shared<Ast::Impl>(root, rhs.root), domain);
+	return Formula(Ast::make<Ast::Impl>(root, rhs.root), domain);
 }
 
 Formula Formula::eqvf(const Formula& rhs) const {
 	if (domain != rhs.domain)
 		throw X::Formula::Connective(Ast::Type::Eqv, domain, rhs.domain);
-	return Formula(make_shared<Ast::Eqv>(root, rhs.root), domain);
+	return Formula(Ast::make<Ast::Eqv>(root, rhs.root), domain);
 }
 
 Formula Formula::xorf(const Formula& rhs) const {
 	if (domain != rhs.domain)
 		throw X::Formula::Connective(Ast::Type::Xor, domain, rhs.domain);
-	return Formula(make_shared<Ast::Xor>(root, rhs.root), domain);
+	return Formula(Ast::make<Ast::Xor>(root, rhs.root), domain);
 }
 
 } /* namespace Propcalc */
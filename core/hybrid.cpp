@@ -0,0 +1,194 @@
+/*
+ * hybrid.cpp - Hybrid of the CNF and Tseitin encodings
+ *
+ * Copyright (C) 2020 Tobias Boege
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the Artistic License 2.0
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ */
+
+#include <limits>
+#include <unordered_set>
+#include <unordered_map>
+
+#include <propcalc/hybrid.hpp>
+#include <propcalc/minimize.hpp>
+
+using namespace std;
+
+namespace Propcalc {
+
+static constexpr uint64_t SATURATED = numeric_limits<uint64_t>::max();
+
+static uint64_t add(uint64_t a, uint64_t b) {
+	uint64_t c;
+	return __builtin_add_overflow(a, b, &c) ? SATURATED : c;
+}
+
+static uint64_t mul(uint64_t a, uint64_t b) {
+	uint64_t c;
+	return __builtin_mul_overflow(a, b, &c) ? SATURATED : c;
+}
+
+/**
+ * Upper bounds on the number of clauses in the CNFs of a formula and
+ * of its negation, obtained by distribution, and whether the formula
+ * is a disjunction of literals and constants.
+ */
+struct Bound {
+	uint64_t pos, neg;
+	bool clause;
+};
+
+/*
+ * The bound of a subtree, computed bottom-up without recursion. Shared
+ * subtrees are bounded once and looked up in `memo` afterwards. The
+ * variables of the subtree are collected in `vars`.
+ */
+static Bound bound(const Ast* root, unordered_set<VarRef>& vars) {
+	unordered_map<const Ast*, Bound> memo;
+
+	auto visit = [&] (const Ast* ast, const Bound* v, size_t n) -> Bound {
+		/* A shared subtree which was not entered again. */
+		if (n == 0 && ast->arity())
+			return memo.at(ast);
+
+		Bound r{ SATURATED, SATURATED, false };
+		switch (ast->type()) {
+		case Ast::Type::Const: {
+			bool value = static_cast<const Ast::Const*>(ast)->value;
+			return { !value, value, true };
+		}
+
+		case Ast::Type::Var:
+			vars.insert(static_cast<const Ast::Var*>(ast)->var);
+			return { 1, 1, true };
+
+		case Ast::Type::Not:
+			r = { v[0].neg, v[0].pos, ast->operand(0)->type() == Ast::Type::Var };
+			break;
+
+		case Ast::Type::And:
+			r = { add(v[0].pos, v[1].pos), mul(v[0].neg, v[1].neg), false };
+			break;
+
+		case Ast::Type::Or:
+			r = { mul(v[0].pos, v[1].pos), add(v[0].neg, v[1].neg), v[0].clause && v[1].clause };
+			break;
+
+		case Ast::Type::Impl:
+			r = { mul(v[0].neg, v[1].pos), add(v[0].pos, v[1].neg), false };
+			break;
+
+		/* a = b is (~a | b) & (a | ~b) and a ^ b is (a | b) & (~a | ~b). */
+		case Ast::Type::Eqv:
+			r = { add(mul(v[0].neg, v[1].pos), mul(v[0].pos, v[1].neg)),
+			      add(mul(v[0].pos, v[1].pos), mul(v[0].neg, v[1].neg)), false };
+			break;
+
+		case Ast::Type::Xor:
+			r = { add(mul(v[0].pos, v[1].pos), mul(v[0].neg, v[1].neg)),
+			      add(mul(v[0].neg, v[1].pos), mul(v[0].pos, v[1].neg)), false };
+			break;
+
+		case Ast::Type::AndN:
+			r = { 0, 1, false };
+			for (size_t i = 0; i < n; ++i)
+				r = { add(r.pos, v[i].pos), mul(r.neg, v[i].neg), false };
+			break;
+
+		case Ast::Type::OrN:
+			r = { 1, 0, true };
+			for (size_t i = 0; i < n; ++i)
+				r = { mul(r.pos, v[i].pos), add(r.neg, v[i].neg), r.clause && v[i].clause };
+			break;
+
+		/* An n-ary exclusive or is bounded like the chain of binary ones. */
+		case Ast::Type::XorN:
+			r = v[0];
+			for (size_t i = 1; i < n; ++i)
+				r = { add(mul(r.pos, v[i].pos), mul(r.neg, v[i].neg)),
+				      add(mul(r.neg, v[i].pos), mul(r.pos, v[i].neg)), false };
+			break;
+		}
+		memo.emplace(ast, r);
+		return r;
+	};
+	auto enter = [&] (const Ast* ast, const Ast*, size_t) {
+		return !memo.count(ast);
+	};
+
+	Ast::PostOrder<Bound> walk;
+	return walk.run(root, visit, enter);
+}
+
+uint64_t Hybrid::estimate(const Ast::Ref& ast) {
+	unordered_set<VarRef> vars;
+	return estimate(ast, vars);
+}
+
+uint64_t Hybrid::estimate(const Ast::Ref& ast, unordered_set<VarRef>& vars) {
+	auto b = bound(ast.get(), vars);
+	if (b.clause)
+		return b.pos;
+
+	/* The CNF has at most one clause per row of the truthtable. */
+	const size_t n = vars.size();
+	const uint64_t rows = n < 64 ? uint64_t(1) << n : SATURATED;
+	if (n > Minimize::MAX_VARS)
+		return rows;
+	return min(b.pos, rows);
+}
+
+Hybrid::Hybrid(const Formula& fm, uint64_t budget, bool caching) :
+	Tseitin(fm, Deferred())
+{
+	is_caching() = caching;
+
+	optional<Formula> small;
+	for (auto& ast : CNF::conjuncts(fm)) {
+		unordered_set<VarRef> leaves;
+		if (estimate(ast, leaves) > budget) {
+			encode(ast);
+			continue;
+		}
+
+		/* Register the variables now so that lift/project are complete.
+		 * They were collected by `estimate`, without walking the conjunct
+		 * again. */
+		Formula sub(ast, fm.domain);
+		for (auto v : fm.domain->sort(leaves)) {
+			auto leaf = Ast::make<Ast::Var>(v);
+			populate_variables(leaf, Positive);
+			rename.insert({ v, vars->get(leaf) });
+		}
+		small = small ? *small & sub : sub;
+	}
+	if (small)
+		direct.emplace(*small, false, true);
+	++*this; /* make the first clause available */
+}
+
+Hybrid& Hybrid::operator++(void) {
+	if (direct) {
+		if (*direct) {
+			Clause cl, src = **direct;
+			for (size_t i = 0; i < src.size(); ++i)
+				cl[rename.at(src.vars()[i])] = src.value(i);
+			++*direct;
+			produce(cl);
+			valid = true;
+			return *this;
+		}
+		direct.reset();
+	}
+	Tseitin::operator++();
+	return *this;
+}
+
+} /* namespace Propcalc */
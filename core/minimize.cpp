@@ -0,0 +1,207 @@
+/*
+ * minimize.cpp - Two-level minimization of CNFs
+ *
+ * Copyright (C) 2020 Tobias Boege
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the Artistic License 2.0
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ */
+
+#include <algorithm>
+#include <unordered_set>
+
+#include <propcalc/minimize.hpp>
+
+using namespace std;
+
+namespace Propcalc::Minimize {
+
+/**
+ * A cube is a set of rows of the truth table given by fixing the
+ * variables in `mask` to the bits of `value`. The cubes we deal with
+ * contain only falsifying rows. Each of them corresponds to the clause
+ * forbidding it.
+ */
+struct Cube {
+	uint64_t mask, value;
+
+	bool operator==(const Cube& b) const {
+		return mask == b.mask && value == b.value;
+	}
+
+	/** Call `fn` on every row of the cube. */
+	template<typename F>
+	void each_row(uint64_t full, F&& fn) const {
+		const uint64_t free = full & ~mask;
+		uint64_t s = 0;
+		do {
+			fn(value | s);
+			s = (s - free) & free;
+		} while (s);
+	}
+};
+
+struct CubeHash {
+	size_t operator()(const Cube& c) const {
+		return c.mask * 0x9E3779B97F4A7C15ULL ^ c.value;
+	}
+};
+
+/** The clause forbidding the rows of a cube. */
+static Clause to_clause(const Cube& c, const vector<VarRef>& vars) {
+	Clause cl;
+	for (size_t i = 0; i < vars.size(); ++i) {
+		if ((c.mask >> i) & 1)
+			cl[vars[i]] = !((c.value >> i) & 1);
+	}
+	return cl;
+}
+
+/** All prime cubes of the falsifying rows, by Quine-McCluskey. */
+static vector<Cube> primes(const vector<uint64_t>& offset, uint64_t full) {
+	vector<Cube> primes, level;
+	for (auto r : offset)
+		level.push_back(Cube{full, r});
+
+	/* Level k holds all cubes with k free variables. A cube is prime
+	 * if it cannot be merged with its neighbor along any variable. */
+	while (!level.empty()) {
+		unordered_set<Cube, CubeHash> present(level.begin(), level.end());
+		unordered_set<Cube, CubeHash> merged;
+		vector<Cube> next;
+		for (auto& c : level) {
+			bool is_prime = true;
+			for (uint64_t m = c.mask; m; m &= m - 1) {
+				const uint64_t b = m & -m;
+				if (!present.count(Cube{c.mask, c.value ^ b}))
+					continue;
+				is_prime = false;
+				Cube up{c.mask & ~b, c.value & ~b};
+				if (merged.insert(up).second)
+					next.push_back(up);
+			}
+			if (is_prime)
+				primes.push_back(c);
+		}
+		level = move(next);
+	}
+	return primes;
+}
+
+/** Essential primes, then greedily the ones covering most rows. */
+static vector<Cube> cover(const vector<Cube>& primes, const vector<uint64_t>& offset, uint64_t full) {
+	vector<size_t> index(full + 1);
+	for (size_t i = 0; i < offset.size(); ++i)
+		index[offset[i]] = i;
+
+	vector<vector<size_t>> rows(primes.size());
+	vector<vector<size_t>> covering(offset.size());
+	for (size_t p = 0; p < primes.size(); ++p) {
+		primes[p].each_row(full, [&] (uint64_t r) {
+			rows[p].push_back(index[r]);
+			covering[index[r]].push_back(p);
+		});
+	}
+
+	vector<Cube> chosen;
+	vector<bool> covered(offset.size());
+	size_t left = offset.size();
+	auto choose = [&] (size_t p) {
+		chosen.push_back(primes[p]);
+		for (auto i : rows[p]) {
+			if (!covered[i]) {
+				covered[i] = true;
+				left--;
+			}
+		}
+	};
+
+	for (size_t i = 0; i < offset.size(); ++i) {
+		if (!covered[i] && covering[i].size() == 1)
+			choose(covering[i][0]);
+	}
+
+	while (left) {
+		size_t best = 0, gain = 0;
+		for (size_t p = 0; p < primes.size(); ++p) {
+			size_t g = 0;
+			for (auto i : rows[p])
+				g += !covered[i];
+			/* Prefer shorter clauses among equal gains. */
+			if (g > gain || (g == gain && g && rows[p].size() > rows[best].size())) {
+				best = p;
+				gain = g;
+			}
+		}
+		choose(best);
+	}
+	return chosen;
+}
+
+/** Espresso-style expansion of uncovered rows, then irredundancy. */
+static vector<Cube> expand(const Bittable& bt, const vector<uint64_t>& offset, uint64_t full) {
+	const size_t n = bt.vars().size();
+	vector<unsigned int> count(bt.size());
+	vector<Cube> cubes;
+
+	for (auto r : offset) {
+		if (count[r])
+			continue;
+		/* Drop each variable if the cube on its other side is also
+		 * entirely falsifying. The result is a prime cube. */
+		Cube c{full, r};
+		for (size_t i = 0; i < n; ++i) {
+			const uint64_t b = uint64_t(1) << i;
+			bool inside = true;
+			Cube other{c.mask, c.value ^ b};
+			other.each_row(full, [&] (uint64_t s) { inside &= !bt[s]; });
+			if (inside)
+				c = Cube{c.mask & ~b, c.value & ~b};
+		}
+		c.each_row(full, [&] (uint64_t s) { count[s]++; });
+		cubes.push_back(c);
+	}
+
+	/* Remove cubes all of whose rows are covered by others, trying
+	 * the smallest ones, which make the longest clauses, first. */
+	stable_sort(cubes.begin(), cubes.end(), [] (const Cube& a, const Cube& b) {
+		return __builtin_popcountll(a.mask) > __builtin_popcountll(b.mask);
+	});
+	vector<Cube> kept;
+	for (auto& c : cubes) {
+		bool redundant = true;
+		c.each_row(full, [&] (uint64_t s) { redundant &= count[s] > 1; });
+		if (redundant)
+			c.each_row(full, [&] (uint64_t s) { count[s]--; });
+		else
+			kept.push_back(c);
+	}
+	return kept;
+}
+
+vector<Clause> cnf(const Bittable& bt) {
+	const size_t n = bt.vars().size();
+	const uint64_t full = n >= 64 ? ~uint64_t(0) : (uint64_t(1) << n) - 1;
+
+	vector<uint64_t> offset;
+	for (uint64_t r = 0; r < bt.size(); ++r) {
+		if (!bt[r])
+			offset.push_back(r);
+	}
+
+	vector<Cube> cubes = n <= EXACT_VARS ?
+		cover(primes(offset, full), offset, full) :
+		expand(bt, offset, full);
+
+	vector<Clause> clauses;
+	for (auto& c : cubes)
+		clauses.push_back(to_clause(c, bt.vars()));
+	return clauses;
+}
+
+} /* namespace Propcalc::Minimize */
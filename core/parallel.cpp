@@ -0,0 +1,338 @@
+/*
+ * parallel.cpp - ParallelTruthtable, ParallelCNF, multithreaded drivers
+ *
+ * Copyright (C) 2020 Tobias Boege
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the Artistic License 2.0
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ */
+
+#include <algorithm>
+#include <stdexcept>
+#include <exception>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <queue>
+#include <optional>
+
+#include <propcalc/parallel.hpp>
+#include <propcalc/formula.hpp>
+#include <propcalc/cnf.hpp>
+
+using namespace std;
+
+namespace Propcalc {
+
+namespace {
+
+/**
+ * Shard queues of the workers. Each worker takes shards from the front
+ * of its own queue and, once that is empty, steals from the back of the
+ * other queues.
+ */
+class ShardQueues {
+	struct Queue {
+		mutex lock;
+		deque<uint64_t> shards;
+	};
+	vector<Queue> queues;
+
+public:
+	ShardQueues(uint64_t shards, unsigned int workers) : queues(workers) {
+		/* Give every worker a contiguous range of shards. */
+		for (uint64_t s = 0; s < shards; ++s)
+			queues[s * workers / shards].shards.push_back(s);
+	}
+
+	bool pop(unsigned int self, uint64_t& shard) {
+		const size_t n = queues.size();
+		for (size_t i = 0; i < n; ++i) {
+			Queue& q = queues[(self + i) % n];
+			const lock_guard<mutex> guard(q.lock);
+			if (q.shards.empty())
+				continue;
+			if (i == 0) {
+				shard = q.shards.front();
+				q.shards.pop_front();
+			}
+			else {
+				shard = q.shards.back();
+				q.shards.pop_back();
+			}
+			return true;
+		}
+		return false;
+	}
+};
+
+}
+
+ParallelTruthtable::ParallelTruthtable(const Formula& fm, unsigned int threads, int prefix) :
+	compiled(make_shared<CompiledFormula>(fm)), nthreads(threads)
+{
+	const unsigned int n = vars().size();
+	if (n >= 64)
+		throw length_error("ParallelTruthtable needs fewer than 64 variables");
+
+	if (!nthreads)
+		nthreads = max(1U, thread::hardware_concurrency());
+
+	if (prefix >= 0) {
+		this->prefix = min<unsigned int>(prefix, n);
+		return;
+	}
+
+	/* Aim for 16 shards per thread for load balancing, but keep at least
+	 * 512 rows per shard, so that every block fills a vector register. */
+	unsigned int k = 0;
+	while ((uint64_t(1) << k) < 16 * uint64_t(nthreads))
+		k++;
+	this->prefix = n >= 9 ? min(k, n - 9) : 0;
+}
+
+void ParallelTruthtable::run(const Work& work,
+		const function<void(const function<bool(uint64_t)>&)>& consume) const {
+	const unsigned int n = vars().size();
+	const uint64_t nshards = shards();
+	const uint64_t shard_rows = uint64_t(1) << (n - prefix);
+	const uint64_t shard_words = max<uint64_t>(1, shard_rows / 64);
+	const unsigned int chunk = min<uint64_t>(shard_words, 64 * CompiledFormula::native_words());
+
+	ShardQueues queues(nshards, nthreads);
+	mutex lock;
+	condition_variable changed;
+	vector<bool> done(nshards);
+	atomic<bool> aborted(false);
+	exception_ptr error;
+
+	auto fail = [&] (exception_ptr e) {
+		const lock_guard<mutex> guard(lock);
+		if (!error)
+			error = e;
+		aborted = true;
+		changed.notify_all();
+	};
+
+	auto worker = [&] (unsigned int self) {
+		try {
+			vector<uint64_t> bits(chunk);
+			uint64_t s;
+			while (!aborted && queues.pop(self, s)) {
+				const uint64_t first = s * shard_rows;
+				if (shard_rows < 64) {
+					/* Cut the shard out of the word containing it. */
+					compiled->eval_rows(first & ~uint64_t(63), bits.data(), 1);
+					bits[0] = (bits[0] >> (first % 64)) & ((uint64_t(1) << shard_rows) - 1);
+					work(s, first, bits.data(), 1);
+				}
+				for (uint64_t k = 0; shard_rows >= 64 && k < shard_words && !aborted; k += chunk) {
+					compiled->eval_rows(first + 64 * k, bits.data(), chunk);
+					work(s, first + 64 * k, bits.data(), chunk);
+				}
+				const lock_guard<mutex> guard(lock);
+				done[s] = true;
+				changed.notify_all();
+			}
+		}
+		catch (...) {
+			fail(current_exception());
+		}
+	};
+
+	vector<thread> pool;
+	for (unsigned int i = 0; i < nthreads; ++i)
+		pool.emplace_back(worker, i);
+
+	if (consume) {
+		try {
+			consume([&] (uint64_t s) {
+				unique_lock<mutex> guard(lock);
+				changed.wait(guard, [&] { return done[s] || aborted; });
+				return !aborted.load();
+			});
+		}
+		catch (...) {
+			fail(current_exception());
+		}
+	}
+
+	for (auto& t : pool)
+		t.join();
+	if (error)
+		rethrow_exception(error);
+}
+
+uint64_t ParallelTruthtable::count(void) const {
+	atomic<uint64_t> total(0);
+	run([&] (uint64_t, uint64_t, const uint64_t* bits, unsigned int words) {
+		uint64_t c = 0;
+		for (unsigned int k = 0; k < words; ++k)
+			c += __builtin_popcountll(bits[k]);
+		total += c;
+	});
+	return total;
+}
+
+/* Call `sink` on every set bit in a block of rows. */
+template<typename F>
+static inline void each_row(uint64_t first, const uint64_t* bits, unsigned int words, F&& sink) {
+	for (unsigned int k = 0; k < words; ++k) {
+		for (uint64_t w = bits[k]; w; w &= w - 1)
+			sink(first + 64 * k + __builtin_ctzll(w));
+	}
+}
+
+void ParallelTruthtable::for_each(const function<void(uint64_t)>& sink, bool ordered) const {
+	if (!ordered) {
+		run([&] (uint64_t, uint64_t first, const uint64_t* bits, unsigned int words) {
+			each_row(first, bits, words, sink);
+		});
+		return;
+	}
+
+	/* Only the worker evaluating a shard writes to its buffer. */
+	vector<vector<uint64_t>> buffers(shards());
+	run([&] (uint64_t s, uint64_t first, const uint64_t* bits, unsigned int words) {
+		each_row(first, bits, words, [&] (uint64_t r) {
+			buffers[s].push_back(r);
+		});
+	}, [&] (const function<bool(uint64_t)>& wait) {
+		for (uint64_t s = 0; s < buffers.size(); ++s) {
+			if (!wait(s))
+				return;
+			for (auto r : buffers[s])
+				sink(r);
+			vector<uint64_t>().swap(buffers[s]);
+		}
+	});
+}
+
+vector<uint64_t> ParallelTruthtable::satisfying(void) const {
+	vector<uint64_t> rows;
+	for_each([&] (uint64_t r) { rows.push_back(r); }, true);
+	return rows;
+}
+
+/*
+ * ParallelCNF
+ */
+
+/** State shared between a ParallelCNF and its threads. */
+struct ParallelCNF::Shared {
+	vector<Ast::Ref> conjuncts;
+	Domain* domain;
+	bool ordered;
+	bool minimize;
+
+	atomic<size_t> next{0};
+	atomic<bool> aborted{false};
+
+	mutex lock;
+	condition_variable changed;
+	/* Clauses of the conjuncts which are done, and in which order. */
+	vector<optional<vector<Clause>>> results;
+	std::queue<size_t> done;
+	size_t delivered = 0;
+	exception_ptr error;
+};
+
+ParallelCNF::ParallelCNF(const Formula& fm, unsigned int threads, bool ordered,
+		bool caching, bool minimize) :
+	shared(make_shared<Shared>())
+{
+	is_caching() = caching;
+
+	shared->conjuncts = CNF::conjuncts(fm);
+	shared->domain = fm.domain;
+	shared->ordered = ordered;
+	shared->minimize = minimize;
+	shared->results.resize(shared->conjuncts.size());
+
+	if (!threads)
+		threads = max(1U, thread::hardware_concurrency());
+	threads = min<size_t>(threads, shared->conjuncts.size());
+
+	auto worker = [sh = shared] {
+		size_t i;
+		while (!sh->aborted && (i = sh->next++) < sh->conjuncts.size()) {
+			try {
+				vector<Clause> clauses;
+				for (auto cl : CNF(Formula(sh->conjuncts[i], sh->domain), false, sh->minimize))
+					clauses.push_back(cl);
+				const lock_guard<mutex> guard(sh->lock);
+				sh->results[i] = move(clauses);
+				sh->done.push(i);
+			}
+			catch (...) {
+				const lock_guard<mutex> guard(sh->lock);
+				if (!sh->error)
+					sh->error = current_exception();
+				sh->aborted = true;
+			}
+			sh->changed.notify_all();
+		}
+	};
+	for (unsigned int t = 0; t < threads; ++t)
+		pool.emplace_back(worker);
+
+	/* Make the first clause available. The destructor does not run
+	 * if this throws, so the threads have to be stopped here. */
+	try {
+		++*this;
+	}
+	catch (...) {
+		shared->aborted = true;
+		for (auto& t : pool)
+			t.join();
+		throw;
+	}
+}
+
+ParallelCNF::~ParallelCNF(void) {
+	shared->aborted = true;
+	for (auto& t : pool)
+		t.join();
+}
+
+ParallelCNF& ParallelCNF::operator++(void) {
+	while (pos >= batch.size()) {
+		Shared& sh = *shared;
+		unique_lock<mutex> guard(sh.lock);
+		if (sh.delivered == sh.conjuncts.size()) {
+			valid = false;
+			return *this;
+		}
+
+		/* Wait for the next conjunct in order, or for any one. */
+		size_t i;
+		if (sh.ordered) {
+			i = sh.delivered;
+			sh.changed.wait(guard, [&] { return sh.results[i] || sh.error; });
+		}
+		else {
+			sh.changed.wait(guard, [&] { return !sh.done.empty() || sh.error; });
+			i = sh.error ? 0 : sh.done.front();
+		}
+		if (sh.error)
+			rethrow_exception(sh.error);
+		if (!sh.ordered)
+			sh.done.pop();
+
+		batch = move(*sh.results[i]);
+		sh.results[i].reset();
+		sh.delivered++;
+		pos = 0;
+	}
+	produce(batch[pos++]);
+	return *this;
+}
+
+} /* namespace Propcalc */
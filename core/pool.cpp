@@ -0,0 +1,184 @@
+/*
+ * pool.cpp - Pool, allocator of small blocks for AST nodes
+ *
+ * Copyright (C) 2020 Tobias Boege
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the Artistic License 2.0
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ */
+
+#include <mutex>
+
+#include <propcalc/pool.hpp>
+
+using namespace std;
+
+namespace Propcalc {
+
+static constexpr size_t CLASSES = Pool::MAX_BLOCK / Pool::GRAIN;
+
+/* A free block holds the pointer to the next one. */
+struct Block {
+	Block* next;
+};
+
+/* The free blocks of one size class. */
+struct List {
+	Block* head;
+	size_t size;
+
+	void push(Block* b) {
+		b->next = head;
+		head = b;
+		size++;
+	}
+
+	Block* pop(void) {
+		Block* b = head;
+		head = b->next;
+		size--;
+		return b;
+	}
+
+	/* Move up to n blocks to another list. */
+	void move(List& to, size_t n) {
+		while (n-- && head)
+			to.push(pop());
+	}
+};
+
+/*
+ * The free blocks which no thread holds. It is never destroyed, so that
+ * nodes in static objects can still be freed at exit.
+ */
+struct Global {
+#ifndef PROPCALC_SINGLE_THREADED
+	mutex access;
+#endif
+	List free[CLASSES];
+	size_t reserved;
+};
+
+static Global& global(void) {
+	static Global* g = new Global();
+	return *g;
+}
+
+/* Cut a new slab into free blocks of the given class. Needs the lock to be held! */
+static void carve(Global& g, size_t c) {
+	const size_t size = (c + 1) * Pool::GRAIN;
+	char* slab = static_cast<char*>(::operator new(Pool::SLAB));
+	g.reserved += Pool::SLAB;
+	for (size_t off = 0; off + size <= Pool::SLAB; off += size)
+		g.free[c].push(reinterpret_cast<Block*>(slab + off));
+}
+
+#ifdef PROPCALC_SINGLE_THREADED
+
+void* Pool::allocate(size_t bytes) {
+	if (bytes > MAX_BLOCK)
+		return ::operator new(bytes);
+	const size_t c = (bytes - 1) / GRAIN;
+	Global& g = global();
+	if (!g.free[c].head)
+		carve(g, c);
+	return g.free[c].pop();
+}
+
+void Pool::deallocate(void* p, size_t bytes) noexcept {
+	if (bytes > MAX_BLOCK)
+		return ::operator delete(p);
+	global().free[(bytes - 1) / GRAIN].push(static_cast<Block*>(p));
+}
+
+size_t Pool::reserved(void) {
+	return global().reserved;
+}
+
+#else
+
+/*
+ * The free lists of a thread. They are trivially destructible, so they
+ * stay usable while the thread exits, after its Enrollment is gone.
+ */
+struct Cache {
+	List free[CLASSES];
+	bool enrolled;
+	bool exited;
+};
+
+static thread_local Cache cache;
+
+/* Hands the free lists of a thread to the global ones when it exits. */
+struct Enrollment {
+	~Enrollment(void) {
+		Global& g = global();
+		const lock_guard<mutex> lock(g.access);
+		for (size_t c = 0; c < CLASSES; ++c)
+			cache.free[c].move(g.free[c], cache.free[c].size);
+		cache.exited = true;
+	}
+};
+
+static thread_local Enrollment enrollment;
+
+static void enroll(void) {
+	/* Using the object makes the thread destroy it at exit. */
+	(void) &enrollment;
+	cache.enrolled = true;
+}
+
+void* Pool::allocate(size_t bytes) {
+	if (bytes > MAX_BLOCK)
+		return ::operator new(bytes);
+	const size_t c = (bytes - 1) / GRAIN;
+	List& mine = cache.free[c];
+	if (mine.head)
+		return mine.pop();
+
+	if (!cache.enrolled)
+		enroll();
+	Global& g = global();
+	const lock_guard<mutex> lock(g.access);
+	if (!g.free[c].head)
+		carve(g, c);
+	/* After the thread's exit handler ran, take single blocks. */
+	if (cache.exited)
+		return g.free[c].pop();
+	g.free[c].move(mine, BATCH);
+	return mine.pop();
+}
+
+void Pool::deallocate(void* p, size_t bytes) noexcept {
+	if (bytes > MAX_BLOCK)
+		return ::operator delete(p);
+	const size_t c = (bytes - 1) / GRAIN;
+	List& mine = cache.free[c];
+	if (cache.enrolled && !cache.exited && mine.size < 2 * BATCH) {
+		mine.push(static_cast<Block*>(p));
+		return;
+	}
+
+	if (!cache.enrolled)
+		enroll();
+	Global& g = global();
+	const lock_guard<mutex> lock(g.access);
+	g.free[c].push(static_cast<Block*>(p));
+	if (!cache.exited)
+		mine.move(g.free[c], BATCH);
+}
+
+size_t Pool::reserved(void) {
+	Global& g = global();
+	const lock_guard<mutex> lock(g.access);
+	return g.reserved;
+}
+
+#endif
+
+} /* namespace Propcalc */
@@ -13,6 +13,8 @@
  */
 
 #include <mutex>
+#include <string>
+#include <stdexcept>
 
 #include <propcalc/tseitin.hpp>
 
@@ -20,91 +22,307 @@ using namespace std;
 
 namespace Propcalc {
 
-// TODO: Turn this initializer list into a custom literal?
 using ClauseData = initializer_list<pair<VarRef, bool>>;
-static inline unique_ptr<Clause> make_clause(ClauseData&& cd) {
-	return make_unique<Clause>(forward<ClauseData>(cd));
-}
 
-VarRef Tseitin::Domain::get(std::shared_ptr<Ast> ast) {
+VarRef Tseitin::Domain::get(const Ast::Ref& ast) {
 	const lock_guard<mutex> lock(access);
 
-	VarRef var;
+	/* The cache hashes and compares AST nodes by structure, so this
+	 * finds equal trees even when they are not the same object. */
 	auto it = astcache.find(ast);
-	if (it != astcache.end()) {
-		var = it->second;
+	if (it != astcache.end())
+		return it->second;
+
+	VarRef var;
+	auto uvar = make_unique<Tseitin::Variable>(ast);
+	tie(std::ignore, var) = put_variable(move(uvar), false);
+	astcache.insert({ ast, var });
+	return var;
+}
+
+VarRef Tseitin::Domain::resolve(std::string name) {
+	const string prefix = "Tseitin[";
+	if (name.size() <= prefix.size() || name.compare(0, prefix.size(), prefix) || name.back() != ']')
+		throw out_of_range("not the name of a Tseitin variable: " + name);
+
+	/* Parse into a scratch domain, so that unknown variables are not
+	 * created in the source, and rebuild the tree on the variables of
+	 * the source. */
+	Cache scratch;
+	Ast::Ref parsed;
+	try {
+		parsed = Formula(name.substr(prefix.size(), name.size() - prefix.size() - 1), &scratch).root;
 	}
-	else {
-		/* If the AST node is not cached, we might still have the same
-		 * tree, but not the same AST object cached. We have to do a
-		 * full scan and look for the AST structure. */
-		for (auto& [a, v] : astcache) {
-			if (ast->equals(*a)) {
-				var = v;
-				astcache.insert({ ast, var });
-				goto end;
-			}
+	catch (const X::Formula::Parser& e) {
+		throw out_of_range("not the name of a Tseitin variable: " + name + ": " + e.what());
+	}
+
+	Ast::PostOrder<Ast::Ref> walk;
+	auto ast = walk.run(parsed.get(), [&] (const Ast* node, Ast::Ref* v, size_t n) -> Ast::Ref {
+		switch (node->type()) {
+		case Ast::Type::Const:
+			return Ast::constant(static_cast<const Ast::Const*>(node)->value);
+		case Ast::Type::Var: {
+			VarRef var = source->lookup(static_cast<const Ast::Var*>(node)->var->name);
+			if (!var)
+				throw out_of_range("no such Tseitin variable: " + name);
+			return Ast::make<Ast::Var>(var);
+		}
+		case Ast::Type::Not:  return Ast::make<Ast::Not>(v[0]);
+		case Ast::Type::And:  return Ast::make<Ast::And>(v[0], v[1]);
+		case Ast::Type::Or:   return Ast::make<Ast::Or>(v[0], v[1]);
+		case Ast::Type::Impl: return Ast::make<Ast::Impl>(v[0], v[1]);
+		case Ast::Type::Eqv:  return Ast::make<Ast::Eqv>(v[0], v[1]);
+		case Ast::Type::Xor:  return Ast::make<Ast::Xor>(v[0], v[1]);
+		case Ast::Type::AndN: return Ast::make<Ast::AndN>(vector<Ast::Ref>(v, v + n));
+		case Ast::Type::OrN:  return Ast::make<Ast::OrN>(vector<Ast::Ref>(v, v + n));
+		case Ast::Type::XorN: return Ast::make<Ast::XorN>(vector<Ast::Ref>(v, v + n));
 		}
-		auto uvar = make_unique<Tseitin::Variable>(ast);
-		tie(std::ignore, var) = put_variable(move(uvar));
-		astcache.insert({ ast, var });
+		return nullptr;
+	});
+
+	/* The parser makes binary chains of what may have been an n-ary
+	 * node, so try the flattened subtree as well. */
+	const lock_guard<mutex> lock(access);
+	auto it = astcache.find(ast);
+	if (it == astcache.end())
+		it = astcache.find(Ast::flatten(ast));
+	if (it == astcache.end())
+		throw out_of_range("no such Tseitin variable: " + name);
+	return it->second;
+}
+
+VarRef Tseitin::Domain::lookup(const std::string& name) {
+	try {
+		return resolve(name);
 	}
-end:
-	return var;
+	catch (const out_of_range&) {
+		return Cache::lookup(name);
+	}
+}
+
+vector<Ast::Ref> Tseitin::operands(const Ast::Nary* node) {
+	auto& ops = node->ops;
+	if (node->type() != Ast::Type::XorN || ops.size() <= XOR_WIDTH)
+		return ops;
+	auto mid = ops.begin() + ops.size() / 2;
+	return {
+		Ast::make<Ast::XorN>(vector<Ast::Ref>(ops.begin(), mid)),
+		Ast::make<Ast::XorN>(vector<Ast::Ref>(mid, ops.end())),
+	};
 }
 
-void Tseitin::populate_variables(shared_ptr<Ast> root) {
-	vars->get(root);
-	switch (root->type()) {
-	case Ast::Type::Not:
-		populate_variables(static_cast<Ast::Not*>(root.get())->rhs);
-		break;
-	case Ast::Type::And:
-		populate_variables(static_cast<Ast::And*>(root.get())->lhs);
-		populate_variables(static_cast<Ast::And*>(root.get())->rhs);
-		break;
-	case Ast::Type::Or:
-		populate_variables(static_cast<Ast::Or*>(root.get())->lhs);
-		populate_variables(static_cast<Ast::Or*>(root.get())->rhs);
-		break;
-	case Ast::Type::Impl:
-		populate_variables(static_cast<Ast::Impl*>(root.get())->lhs);
-		populate_variables(static_cast<Ast::Impl*>(root.get())->rhs);
-		break;
-	case Ast::Type::Eqv:
-		populate_variables(static_cast<Ast::Eqv*>(root.get())->lhs);
-		populate_variables(static_cast<Ast::Eqv*>(root.get())->rhs);
-		break;
-	case Ast::Type::Xor:
-		populate_variables(static_cast<Ast::Xor*>(root.get())->lhs);
-		populate_variables(static_cast<Ast::Xor*>(root.get())->rhs);
-		break;
-	default:
-		/* nothing */
-		break;
+size_t Tseitin::populate_parity(const vector<Ast::Ref>& ops, const size_t* slots) {
+	auto ast = Ast::make<Ast::XorN>(ops);
+	auto c = vars->get(ast);
+	auto& s = seen[c];
+	const bool fresh = !s.pol;
+	s.pol = Both;
+	if (!fresh)
+		return s.slot;
+
+	size_t pos = order.size();
+	order.push_back(c);
+	vector<size_t> sub(slots, slots + ops.size());
+	if (ops.size() > XOR_WIDTH) {
+		const size_t mid = ops.size() / 2;
+		sub = {
+			populate_parity(vector<Ast::Ref>(ops.begin(), ops.begin() + mid), slots),
+			populate_parity(vector<Ast::Ref>(ops.begin() + mid, ops.end()), slots + mid),
+		};
 	}
+	nodes.push_back(Node{ ast.get(), pos, args.size(), sub.size() });
+	args.insert(args.end(), sub.begin(), sub.end());
+	return seen[c].slot = nodes.size() - 1;
+}
+
+size_t Tseitin::populate_variables(const Ast::Ref& root, unsigned char pol) {
+	/* What `enter` found out about each node on the traversal stack. */
+	struct Entry {
+		/* Elements of an unordered_map stay where they are. */
+		Seen* seen;
+		unsigned char pol;
+		bool fresh, skip;
+		size_t pos;
+	};
+	vector<Entry> entries;
+
+	auto enter = [&] (const Ast* node, const Ast* parent, size_t i) {
+		/* The polarity of a child is that of its parent, flipped under Not
+		 * and on the left of Impl. The operands of Eqv and Xor occur in both. */
+		unsigned char p = pol;
+		if (parent) {
+			p = entries.back().pol;
+			const unsigned char flip = ((p & Positive) << 1) | ((p & Negative) >> 1);
+			switch (parent->type()) {
+			case Ast::Type::Not:
+				p = flip;
+				break;
+			case Ast::Type::Impl:
+				p = i == 0 ? flip : p;
+				break;
+			case Ast::Type::Eqv:
+			case Ast::Type::Xor:
+			case Ast::Type::XorN:
+				p = Both;
+				break;
+			default:
+				break;
+			}
+		}
+
+		/* Visit shared subtrees again only with a new polarity. */
+		auto c = vars->get(parent ? parent->operand(i) : root);
+		auto& s = seen[c];
+		Entry e{ &s, p, !s.pol, (s.pol | p) == s.pol, order.size() };
+		s.pol |= p;
+
+		/* Variables enter the domain in this order. */
+		if (e.fresh) {
+			order.push_back(c);
+			if (node->type() == Ast::Type::Var) {
+				leaves.push_back(e.pos);
+				sources.push_back(static_cast<const Ast::Var*>(node)->var);
+			}
+		}
+		entries.push_back(e);
+		return !e.skip;
+	};
+
+	auto visit = [&] (const Ast* node, const size_t* slots, size_t n) {
+		auto e = entries.back();
+		entries.pop_back();
+		if (!e.fresh)
+			return e.seen->slot;
+
+		size_t lhs = 0, rhs = 0;
+		switch (node->type()) {
+		case Ast::Type::Not:
+			lhs = slots[0];
+			break;
+		case Ast::Type::And:
+		case Ast::Type::Or:
+		case Ast::Type::Impl:
+		case Ast::Type::Eqv:
+		case Ast::Type::Xor:
+			lhs = slots[0];
+			rhs = slots[1];
+			break;
+		case Ast::Type::XorN:
+			/* See `operands` for the split into halves. */
+			if (n > XOR_WIDTH) {
+				auto& ops = static_cast<const Ast::Nary*>(node)->ops;
+				const size_t mid = n / 2;
+				const size_t a = populate_parity(vector<Ast::Ref>(ops.begin(), ops.begin() + mid), slots);
+				const size_t b = populate_parity(vector<Ast::Ref>(ops.begin() + mid, ops.end()), slots + mid);
+				lhs = args.size();
+				rhs = 2;
+				args.push_back(a);
+				args.push_back(b);
+				break;
+			}
+			/* fall through */
+		case Ast::Type::AndN:
+		case Ast::Type::OrN:
+			lhs = args.size();
+			rhs = n;
+			args.insert(args.end(), slots, slots + n);
+			break;
+		default:
+			/* nothing */
+			break;
+		}
+
+		nodes.push_back(Node{ node, e.pos, lhs, rhs });
+		return e.seen->slot = nodes.size() - 1;
+	};
+
+	Ast::PostOrder<size_t> walk;
+	return walk.run(root.get(), visit, enter);
 }
 
-Tseitin::Tseitin(const Formula& fm) : fm(fm) {
-	vars = std::make_shared<Tseitin::Domain>();
+Tseitin::Tseitin(const Formula& fm, Deferred) :
+	fm(fm), vars(std::make_shared<Tseitin::Domain>(fm.domain)), valid(false)
+{
 	domain = vars.get();
+}
+
+Tseitin::Tseitin(const Formula& fm, bool caching, bool polarity) : Tseitin(fm, Deferred()) {
+	is_caching() = caching;
+	this->polarity = polarity;
+	encode(fm.root);
+	++*this; /* make the first clause available */
+}
+
+void Tseitin::encode(const Ast::Ref& root) {
+	if (!asserted.insert(vars->get(root)).second)
+		return;
 	/* Populate the Tseitin variable domain first so that
 	 * lift/project work as soon as the constructor ran. */
-	populate_variables(fm.root);
+	populate_variables(root, Positive);
 	/* Require that the root node be true. */
-	clauses.push(make_clause({ {vars->get(fm.root), true} }));
+	clauses.push({ {vars->get(root), true} });
 	/* Kick off recursive conversion of the AST structure
 	 * into CNF clauses. */
-	queue.push(fm.root);
-	++*this; /* make the first clause available */
+	queue.push(root);
+}
+
+Assignment Tseitin::lift(const Assignment& assign) {
+	if (lifted.size() != order.size())
+		lifted = Assignment(order);
+	Assignment lassign(lifted);
+
+	values.resize(nodes.size());
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		auto& n = nodes[i];
+		bool v = false;
+		switch (n.ast->type()) {
+			case Ast::Type::Const: v = static_cast<const Ast::Const*>(n.ast)->value;     break;
+			case Ast::Type::Var:   v = assign[static_cast<const Ast::Var*>(n.ast)->var]; break;
+			case Ast::Type::Not:   v = !values[n.lhs];                   break;
+			case Ast::Type::And:   v = values[n.lhs] && values[n.rhs];   break;
+			case Ast::Type::Or:    v = values[n.lhs] || values[n.rhs];   break;
+			case Ast::Type::Impl:  v = !values[n.lhs] || values[n.rhs];  break;
+			case Ast::Type::Eqv:   v = values[n.lhs] == values[n.rhs];   break;
+			case Ast::Type::Xor:   v = values[n.lhs] != values[n.rhs];   break;
+			case Ast::Type::AndN:
+				v = true;
+				for (size_t k = n.lhs; k < n.lhs + n.rhs; ++k)
+					v = v && values[args[k]];
+				break;
+			case Ast::Type::OrN:
+				for (size_t k = n.lhs; k < n.lhs + n.rhs; ++k)
+					v = v || values[args[k]];
+				break;
+			case Ast::Type::XorN:
+				for (size_t k = n.lhs; k < n.lhs + n.rhs; ++k)
+					v = v != bool(values[args[k]]);
+				break;
+		}
+		values[i] = v;
+		if (v)
+			lassign.flip(n.pos);
+	}
+	return lassign;
+}
+
+Assignment Tseitin::project(const Assignment& lassign) {
+	if (projected.size() != sources.size())
+		projected = Assignment(sources);
+	Assignment assign(projected);
+
+	for (size_t i = 0; i < leaves.size(); ++i) {
+		if (lassign[order[leaves[i]]])
+			assign.flip(i);
+	}
+	return assign;
 }
 
 Tseitin& Tseitin::operator++(void) {
 	while (true) {
-		if (clauses.size() > 0) {
-			last = move(clauses.front());
-			clauses.pop();
-			produce(*last);
+		if (!clauses.empty()) {
+			clauses.pop(value);
+			produced();
 			valid = true;
 			break; /* found the next clause */
 		}
@@ -118,14 +336,40 @@ Tseitin& Tseitin::operator++(void) {
 		 * Note: there are some clauses below which are conditioned on a != b.
 		 * This is because the Clause class cannot hold the same variable a
 		 * in both a positive and a negative literal. Since whenever this is
-		 * a problem the clause is also vacuously fulfilled, we leave them out. */
+		 * a problem the clause is also vacuously fulfilled, we leave them out.
+		 * In polarity mode, `define` drops the clauses which are not needed. */
 		auto ast = queue.front();
 		queue.pop();
+
+		/* Emit only the directions of the definition which are needed
+		 * and were not emitted before, and only then visit the operands.
+		 * The clauses with a negative c make up `c -> definition`, which
+		 * is needed if the node occurs positively, the others the converse. */
+		auto node = vars->get(ast);
+		auto& done = defined[node];
+		const bool first = !done;
+		const unsigned char want = (polarity ? seen.at(node).pol : (unsigned char) Both) & ~done;
+		if (!want)
+			continue;
+		done |= want;
+		auto define = [&] (VarRef c, ClauseData cd) {
+			for (auto& [v, sign] : cd) {
+				if (v == c && !(want & (sign ? Negative : Positive)))
+					return;
+			}
+			clauses.push(cd);
+		};
+		/* The same for the clause in `scratch`. */
+		auto define_scratch = [&] (VarRef c) {
+			if (want & (scratch.value(scratch.position(c)) ? Negative : Positive))
+				clauses.push(scratch);
+		};
 		switch (ast->type()) {
 			case Ast::Type::Const: {
 				auto C = static_cast<Ast::Const*>(ast.get());
 				auto c = vars->get(ast);
-				clauses.push(make_clause({ {c, C->value} }));
+				if (first)
+					clauses.push({ {c, C->value} });
 				break;
 			}
 
@@ -138,8 +382,8 @@ Tseitin& Tseitin::operator++(void) {
 				auto C = static_cast<Ast::Not*>(ast.get());
 				auto c = vars->get(ast);
 				auto a = vars->get(C->rhs);
-				clauses.push(make_clause({ {a, false}, {c, false} }));
-				clauses.push(make_clause({ {a,  true}, {c,  true} }));
+				define(c, { {a, false}, {c, false} });
+				define(c, { {a,  true}, {c,  true} });
 				queue.push(C->rhs);
 				break;
 			}
@@ -149,9 +393,9 @@ Tseitin& Tseitin::operator++(void) {
 				auto c = vars->get(ast);
 				auto a = vars->get(C->lhs);
 				auto b = vars->get(C->rhs);
-				clauses.push(make_clause({ {a, false}, {b, false}, {c,  true} }));
-				clauses.push(make_clause({ {a,  true},             {c, false} }));
-				clauses.push(make_clause({             {b,  true}, {c, false} }));
+				define(c, { {a, false}, {b, false}, {c,  true} });
+				define(c, { {a,  true},             {c, false} });
+				define(c, {             {b,  true}, {c, false} });
 				queue.push(C->lhs);
 				queue.push(C->rhs);
 				break;
@@ -162,9 +406,9 @@ Tseitin& Tseitin::operator++(void) {
 				auto c = vars->get(ast);
 				auto a = vars->get(C->lhs);
 				auto b = vars->get(C->rhs);
-				clauses.push(make_clause({ {a,  true}, {b,  true}, {c, false} }));
-				clauses.push(make_clause({ {a, false},             {c,  true} }));
-				clauses.push(make_clause({             {b, false}, {c,  true} }));
+				define(c, { {a,  true}, {b,  true}, {c, false} });
+				define(c, { {a, false},             {c,  true} });
+				define(c, {             {b, false}, {c,  true} });
 				queue.push(C->lhs);
 				queue.push(C->rhs);
 				break;
@@ -176,9 +420,9 @@ Tseitin& Tseitin::operator++(void) {
 				auto a = vars->get(C->lhs);
 				auto b = vars->get(C->rhs);
 				if (a != b)
-					clauses.push(make_clause({ {a, false}, {b,  true}, {c, false} }));
-				clauses.push(    make_clause({ {a,  true},             {c,  true} }));
-				clauses.push(    make_clause({             {b, false}, {c,  true} }));
+					define(c, { {a, false}, {b,  true}, {c, false} });
+				define(c,     { {a,  true},             {c,  true} });
+				define(c,     {             {b, false}, {c,  true} });
 				queue.push(C->lhs);
 				queue.push(C->rhs);
 				break;
@@ -189,11 +433,11 @@ Tseitin& Tseitin::operator++(void) {
 				auto c = vars->get(ast);
 				auto a = vars->get(C->lhs);
 				auto b = vars->get(C->rhs);
-				clauses.push(    make_clause({ {a, false}, {b, false}, {c,  true} }));
-				clauses.push(    make_clause({ {a,  true}, {b,  true}, {c,  true} }));
+				define(c,     { {a, false}, {b, false}, {c,  true} });
+				define(c,     { {a,  true}, {b,  true}, {c,  true} });
 				if (a != b) {
-					clauses.push(make_clause({ {a,  true}, {b, false}, {c, false} }));
-					clauses.push(make_clause({ {a, false}, {b,  true}, {c, false} }));
+					define(c, { {a,  true}, {b, false}, {c, false} });
+					define(c, { {a, false}, {b,  true}, {c, false} });
 				}
 				queue.push(C->lhs);
 				queue.push(C->rhs);
@@ -205,19 +449,87 @@ Tseitin& Tseitin::operator++(void) {
 				auto c = vars->get(ast);
 				auto a = vars->get(C->lhs);
 				auto b = vars->get(C->rhs);
-				clauses.push(    make_clause({ {a, false}, {b, false}, {c, false} }));
-				clauses.push(    make_clause({ {a,  true}, {b,  true}, {c, false} }));
+				define(c,     { {a, false}, {b, false}, {c, false} });
+				define(c,     { {a,  true}, {b,  true}, {c, false} });
 				if (a != b) {
-					clauses.push(make_clause({ {a,  true}, {b, false}, {c,  true} }));
-					clauses.push(make_clause({ {a, false}, {b,  true}, {c,  true} }));
+					define(c, { {a,  true}, {b, false}, {c,  true} });
+					define(c, { {a, false}, {b,  true}, {c,  true} });
 				}
 				queue.push(C->lhs);
 				queue.push(C->rhs);
 				break;
 			}
+
+			/* `c = a1 & ... & an` is `~a1 | ... | ~an | c` and `ai | ~c`
+			 * for every i, and dually for the disjunction. */
+			case Ast::Type::AndN:
+			case Ast::Type::OrN: {
+				const bool conj = ast->type() == Ast::Type::AndN;
+				auto c = vars->get(ast);
+				auto ops = operands(static_cast<Ast::Nary*>(ast.get()));
+				scratch.clear();
+				for (auto& op : ops) {
+					auto a = vars->get(op);
+					define(c, { {a, conj}, {c, !conj} });
+					scratch[a] = !conj;
+				}
+				scratch[c] = conj;
+				define_scratch(c);
+				for (auto& op : ops)
+					queue.push(op);
+				break;
+			}
+
+			/* Every assignment to the operands gets a clause which forbids
+			 * c to differ from their parity. If an operand occurs twice,
+			 * the clauses in which it has both signs are left out. */
+			case Ast::Type::XorN: {
+				auto c = vars->get(ast);
+				auto ops = operands(static_cast<Ast::Nary*>(ast.get()));
+				vector<VarRef> a;
+				for (auto& op : ops)
+					a.push_back(vars->get(op));
+				for (unsigned int m = 0; m < (1u << a.size()); ++m) {
+					scratch.clear();
+					bool taut = false;
+					for (size_t i = 0; i < a.size(); ++i) {
+						const bool sign = !((m >> i) & 1);
+						const size_t j = scratch.position(a[i]);
+						taut |= j != Clause::npos && scratch.value(j) != sign;
+						scratch[a[i]] = sign;
+					}
+					if (taut)
+						continue;
+					scratch[c] = __builtin_popcount(m) & 1;
+					define_scratch(c);
+				}
+				for (auto& op : ops)
+					queue.push(op);
+				break;
+			}
 		}
 	}
 	return *this;
 }
 
+/*
+ * Tseitin::Incremental
+ */
+
+Tseitin::Incremental::Incremental(Propcalc::Domain* source, bool caching, bool polarity) :
+	Tseitin(Formula(Ast::constant(true), source), Deferred())
+{
+	is_caching() = caching;
+	this->polarity = polarity;
+}
+
+Tseitin::Incremental& Tseitin::Incremental::add(const Formula& fm) {
+	if (fm.domain != this->fm.domain)
+		throw invalid_argument("formula is not on the source domain of the encoder");
+	encode(fm.root);
+	if (!valid)
+		++*this; /* make the first new clause available */
+	return *this;
+}
+
 }
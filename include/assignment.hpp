@@ -18,6 +18,7 @@
 #include <iostream>
 
 #include <vector>
+#include <cstdint>
 #include <unordered_map>
 
 #include <propcalc/varmap.hpp>
@@ -47,8 +48,14 @@ namespace Propcalc {
 		Assignment(std::vector<VarRef> vars) : VarMap(vars), overflow(false) { }
 		/** Initialize the mapping with the given data. */
 		Assignment(std::initializer_list<std::pair<VarRef, bool>> il) : VarMap(il), overflow(false) { }
+		/**
+		 * Create the assignment of the given rank on the given variables,
+		 * see `rank`. Bits of `r` past the number of variables are ignored
+		 * and variables past the 64th are false.
+		 */
+		Assignment(std::vector<VarRef> vars, uint64_t r);
 		/** Initialize the assignment from a VarMap object. */
-		Assignment(VarMap&& vm) : VarMap(vm), overflow(false) { }
+		Assignment(VarMap&& vm) : VarMap(std::move(vm)), overflow(false) { }
 
 		/**
 		 * Whether or not the last increment caused the assignment
@@ -57,6 +64,21 @@ namespace Propcalc {
 		bool  overflown(void) const { return overflow; }
 		bool& overflown(void)       { return overflow; }
 
+		/**
+		 * The rank of the assignment among all assignments on its variables
+		 * in the order produced by `operator++` from the all-false one:
+		 * the variable at position i has the value of bit i of the rank.
+		 * An std::length_error is thrown for more than 64 variables.
+		 */
+		uint64_t rank(void) const;
+
+		/**
+		 * The rank with respect to another order of variables, for example
+		 * that of `Formula::vars()`. All of them must be defined, otherwise
+		 * an std::out_of_range exception is thrown.
+		 */
+		uint64_t rank(const std::vector<VarRef>& vars) const;
+
 		/** The negated assignment. */
 		Assignment operator~(void) const;
 
@@ -73,7 +95,7 @@ namespace Propcalc {
 		std::ostream& operator<<(std::ostream& os, const Assignment& assign) {
 			os << "{ ";
 			for (auto& v : assign.vars())
-				os << v->name << "(" << assign[v] << ") ";
+				os << v->get_name() << "(" << assign[v] << ") ";
 			return os << "}";
 		}
 	}
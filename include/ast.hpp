@@ -16,17 +16,26 @@
 #define PROPCALC_AST_HPP
 
 #include <string>
+#include <iosfwd>
 #include <memory>
 #include <vector>
+#include <mutex>
+#include <typeinfo>
+#include <initializer_list>
+#include <functional>
+#include <unordered_map>
 
+#include <propcalc/pool.hpp>
 #include <propcalc/domain.hpp>
 #include <propcalc/assignment.hpp>
 
 namespace Propcalc {
 	/**
-	 * Ast is the base class for all AST nodes. It contains virtual methods
-	 * to identify the type of node, for stringification and evaluation,
-	 * which have to be overloaded to provide the specific node's semantics.
+	 * Ast is the base class for all AST nodes. The subclasses provide the
+	 * precedence, associativity and evaluation of each connective. The
+	 * other algorithms on subtrees are written once, on Ast::PostOrder,
+	 * and dispatch on the node's type, so that they do not recurse once
+	 * per level of the formula.
 	 */
 	class Ast {
 	public:
@@ -39,7 +48,8 @@ namespace Propcalc {
 		enum class Type {
 			Const, Var,
 			Not, And, Or,
-			Impl, Eqv, Xor
+			Impl, Eqv, Xor,
+			AndN, OrN, XorN
 		};
 
 		/**
@@ -67,15 +77,120 @@ namespace Propcalc {
 			Loose    = 0
 		};
 
+		/**
+		 * Structural hash of the subtree rooted at this node, computed
+		 * once at construction. Equal subtrees have equal hashes.
+		 */
+		const size_t hash;
+
+		/** This node's Ast::Type. It is stored to spare traversals a virtual call. */
+		const Ast::Type kind;
+
+		/**
+		 * Whether this node and all of its descendants were created by
+		 * the hash-consing factory Ast::make. Two distinct interned nodes
+		 * are never structurally equal. Interned nodes are shared between
+		 * all formulas containing them and must not be modified.
+		 */
+		bool interned = false;
+
+#ifdef PROPCALC_SINGLE_THREADED
+	private:
+		/* References to this node, counted by Ast::Ref. */
+		unsigned int refs = 0;
+		/* The next node in the same bucket of the unique table. */
+		Ast* next_entry = nullptr;
+
+		/* Called when the last reference to the node is dropped. */
+		static void dispose(Ast* node);
+
+	public:
+		/**
+		 * A reference to a node. In the single-threaded build, the count
+		 * of references is kept in the node itself and is not atomic:
+		 * there is no control block, a reference is one pointer and
+		 * copying it costs a plain increment. Nodes must then not be
+		 * shared between threads. The interface is the part of
+		 * `std::shared_ptr` used by the library, which Ast::Ref is otherwise.
+		 */
+		class Ref {
+			Ast* node = nullptr;
+
+		public:
+			Ref(void) = default;
+			Ref(std::nullptr_t) { }
+			explicit Ref(Ast* node) : node(node) { if (node) node->refs++; }
+			Ref(const Ref& r) : Ref(r.node) { }
+			Ref(Ref&& r) noexcept : node(r.node) { r.node = nullptr; }
+			~Ref(void) { reset(); }
+
+			Ref& operator=(Ref r) noexcept {
+				std::swap(node, r.node);
+				return *this;
+			}
+
+			void reset(void) {
+				Ast* old = node;
+				node = nullptr;
+				if (old && !--old->refs)
+					dispose(old);
+			}
+
+			Ast* get(void) const        { return node;  }
+			Ast& operator*(void) const  { return *node; }
+			Ast* operator->(void) const { return node;  }
+			explicit operator bool(void) const { return node != nullptr; }
+			long use_count(void) const { return node ? node->refs : 0; }
+
+			friend bool operator==(const Ref& a, const Ref& b) { return a.node == b.node; }
+			friend bool operator!=(const Ref& a, const Ref& b) { return a.node != b.node; }
+		};
+
+		/* Nodes are allocated from the Pool, which is told their size. */
+		static void* operator new(size_t bytes) { return Pool::allocate(bytes); }
+		static void operator delete(void* p, size_t bytes) { Pool::deallocate(p, bytes); }
+#else
+		/** A reference to a node. */
+		using Ref = std::shared_ptr<Ast>;
+#endif
+
+		Ast(Ast::Type kind, size_t hash) : hash(hash), kind(kind) { }
+		virtual ~Ast(void) { }
+
 		/** Return this node's Ast::Type. */
-		virtual Ast::Type  type(void)  const = 0;
+		Ast::Type type(void) const { return kind; }
 		/** Return this node's Ast::Assoc. */
 		virtual Ast::Assoc assoc(void) const = 0;
 		/** Return this node's Ast::Prec. */
 		virtual Ast::Prec  prec(void)  const = 0;
 
-		/** Whether two subtrees are recursively equal. */
-		virtual bool equals(const Ast& b) const = 0;
+		/** The number of operands of this node. */
+		size_t arity(void) const;
+
+		/**
+		 * The operand at index i, from left to right. The operand of
+		 * Ast::Not is its `rhs`. The index must be below `arity()`.
+		 */
+		const Ast::Ref& operand(size_t i) const;
+
+		/**
+		 * Whether two subtrees are recursively equal. This is a pointer
+		 * comparison if both nodes are interned.
+		 */
+		bool equals(const Ast& b) const {
+			if (this == &b)
+				return true;
+			if (interned && b.interned)
+				return false;
+			/* Equal subtrees have equal hashes. */
+			return hash == b.hash && equals_structure(b);
+		}
+
+		/**
+		 * Compare the subtrees node by node. Use `equals` instead which
+		 * takes shortcuts.
+		 */
+		bool equals_structure(const Ast& b) const;
 
 		/**
 		 * Evaluate the subtree rooted at this node on the given assignment.
@@ -86,253 +201,680 @@ namespace Propcalc {
 		 * can succeed (is not guaranteed to throw an exception), because
 		 * conjunction, disjunction and implication short-circuit.
 		 */
-		virtual bool eval(const Assignment& assign) const = 0;
+		bool eval(const Assignment& assign) const { return eval_at(assign, 0); }
 
 		/**
-		 * Evaluate the subtree rooted at this node on the given (partial)
-		 * assignment. This has the effect of replacing all variables
-		 * defined in the assignment with their values and inductively
-		 * simplifying the AST nodes involving constants. The resulting
-		 * formula is either a sole constant or does not have any constant
-		 * nodes or variable nodes referred to in the assignment anymore.
+		 * Evaluate this node `depth` levels below the one on which
+		 * `eval` was called. Nodes evaluate their operands with
+		 * `eval_below`, recursively, which is fastest on shallow formulas.
 		 */
-		virtual std::shared_ptr<Ast> simplify(const Assignment& assign) const = 0;
+		virtual bool eval_at(const Assignment& assign, size_t depth) const = 0;
+
+		/**
+		 * Evaluate an operand at the given depth. Below RECURSION levels,
+		 * the remaining subtree is evaluated by an iterative PostOrder
+		 * traversal, so that deep formulas do not overflow the stack.
+		 */
+		bool eval_below(const Assignment& assign, size_t depth) const {
+			return depth < RECURSION ? eval_at(assign, depth) : eval_iterative(assign);
+		}
+
+		/** Evaluate without recursion, see `eval_below`. */
+		bool eval_iterative(const Assignment& assign) const;
+
+		/** Depth up to which traversals recurse on the C++ stack. */
+		static constexpr size_t RECURSION = 256;
 
 		/** Convert subtree to infix. */
-		virtual std::string to_infix(void)   const = 0;
+		std::string to_infix(void)   const { std::string s; write_infix(s);   return s; }
 		/** Convert subtree to prefix (polish notation). */
-		virtual std::string to_prefix(void)  const = 0;
+		std::string to_prefix(void)  const { std::string s; write_prefix(s);  return s; }
 		/** Convert subtree to postfix (reverse polish notation). */
-		virtual std::string to_postfix(void) const = 0;
+		std::string to_postfix(void) const { std::string s; write_postfix(s); return s; }
+
+		/**
+		 * Write the subtree in infix, prefix or postfix notation. The
+		 * text is appended to a string or written to a stream in one
+		 * pass over the nodes, without building the strings of the
+		 * subtrees first, so the time is linear in the length of the
+		 * text, however deep the formula. Streams are written to in
+		 * large blocks.
+		 */
+		void write_infix(std::string& out)   const;
+		void write_infix(std::ostream& os)   const;
+		void write_prefix(std::string& out)  const;
+		void write_prefix(std::ostream& os)  const;
+		void write_postfix(std::string& out) const;
+		void write_postfix(std::ostream& os) const;
+
+		template<typename R>
+		class PostOrder;
+
+		/**
+		 * Return a node of type T with the given constructor arguments.
+		 * If such a node is still alive, it is returned instead of a new
+		 * one. Operands are compared by identity, so when all nodes of a
+		 * formula are created this way, it is stored as a DAG in which
+		 * every subformula occurs exactly once.
+		 */
+		template<typename T, typename... Args>
+		static Ast::Ref make(Args&&... args);
+
+		/**
+		 * Return a new node of type T with the given constructor arguments,
+		 * which is not entered into the unique table. The node and its
+		 * reference counts are allocated together from the Pool.
+		 */
+		template<typename T, typename... Args>
+		static Ast::Ref fresh(Args&&... args) {
+#ifdef PROPCALC_SINGLE_THREADED
+			return Ast::Ref(new T(std::forward<Args>(args)...));
+#else
+			return std::allocate_shared<T>(Pool::Allocator<T>(), std::forward<Args>(args)...);
+#endif
+		}
+
+		class Table;
+		/** The unique table used by Ast::make. */
+		static Table table;
+
+		/** Combine the hashes of a node's type and its operands. */
+		static size_t hash_of(Ast::Type type, std::initializer_list<size_t> parts) {
+			size_t seed = static_cast<size_t>(type);
+			for (auto v : parts)
+				seed ^= v + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+			return seed;
+		}
+
+		/** Hash functor for Ast nodes by structure, using `hash`. */
+		struct Hash {
+			size_t operator()(const Ast::Ref& a) const { return a->hash; }
+		};
+
+		/**
+		 * Drop a reference to an operand from the destructor of its
+		 * parent. If it was the last one, the operand is destroyed by the
+		 * outermost call on the stack instead of recursively, so that
+		 * freeing a deep formula does not overflow the stack.
+		 */
+		static void release(Ast::Ref& op);
+
+		/** Equality functor for Ast nodes by structure, using `equals`. */
+		struct Equal {
+			bool operator()(const Ast::Ref& a, const Ast::Ref& b) const {
+				return a->equals(*b);
+			}
+		};
 
 		class Const;
 		class Var;
 		class Not;
+		class Binary;
 		class And;
 		class Or;
 		class Impl;
 		class Eqv;
 		class Xor;
+		class Nary;
+		class AndN;
+		class OrN;
+		class XorN;
+
+		/**
+		 * Return an equivalent subtree in which every maximal chain of
+		 * conjunctions, of disjunctions or of exclusive ors, binary or
+		 * n-ary, is replaced by one n-ary node with the operands of the
+		 * chain from left to right. Other nodes are kept if none of
+		 * their operands changed. The traversal uses an explicit stack,
+		 * so arbitrarily deep chains can be flattened.
+		 *
+		 * The inner nodes of a chain are not looked at as shared
+		 * subtrees. If one of them occurs elsewhere, its operands are
+		 * copied into each chain containing it.
+		 */
+		static Ast::Ref flatten(const Ast::Ref& root);
+
+		/**
+		 * The constant node of the given value. There is one such node
+		 * per value, which is also the one in the unique table.
+		 */
+		static const Ast::Ref& constant(bool value);
+
+		/**
+		 * Evaluate the subtree on the given (partial) assignment. This
+		 * has the effect of replacing all variables defined in the
+		 * assignment with their values and inductively simplifying the
+		 * AST nodes involving constants. The resulting formula is either
+		 * a sole constant or does not have any constant nodes or variable
+		 * nodes referred to in the assignment anymore.
+		 *
+		 * Subtrees which do not change are shared with the input, not
+		 * copied: nodes are only allocated on the paths from the assigned
+		 * variables and constants to the root, and if nothing changes,
+		 * `root` itself is returned. Constants are the nodes of `constant`.
+		 */
+		static Ast::Ref simplify(const Ast::Ref& root, const Assignment& assign);
 	};
 
 	class Ast::Const : public Ast {
 	public:
 		bool value;
 
-		Const(bool value) : value(value) { }
+		Const(bool value) : Ast(Ast::Type::Const, hash_of(value)), value(value) { }
+
+		static size_t hash_of(bool value) {
+			return Ast::hash_of(Ast::Type::Const, { std::hash<bool>()(value) });
+		}
 
-		virtual Ast::Type  type(void)  const { return Ast::Type::Const;    }
 		virtual Ast::Assoc assoc(void) const { return Ast::Assoc::Non;     }
 		virtual Ast::Prec  prec(void)  const { return Ast::Prec::Symbolic; }
 
-		virtual bool equals(const Ast& b) const {
-			if (b.type() != Ast::Type::Const)
-				return false;
-			return static_cast<const Ast::Const&>(b).value == value;
-		}
+		virtual bool eval_at(const Assignment&, size_t) const { return value; }
 
-		virtual bool eval(const Assignment&) const { return value; }
-		virtual std::shared_ptr<Ast> simplify(const Assignment&) const {
-			return std::make_shared<Ast::Const>(value);
-		}
+		bool has_key(bool value) const { return this->value == value; }
 
-		virtual std::string to_string(void)  const { return value ? "\\T" : "\\F"; }
-		virtual std::string to_infix(void)   const { return this->to_string(); }
-		virtual std::string to_prefix(void)  const { return this->to_string(); }
-		virtual std::string to_postfix(void) const { return this->to_string(); }
+		std::string to_string(void) const { return value ? "\\T" : "\\F"; }
 	};
 
 	class Ast::Var : public Ast {
 	public:
 		VarRef var;
 
-		Var(VarRef var) : var(var) { }
+		Var(VarRef var) : Ast(Ast::Type::Var, hash_of(var)), var(var) { }
+
+		static size_t hash_of(VarRef var) {
+			return Ast::hash_of(Ast::Type::Var, { std::hash<VarRef>()(var) });
+		}
 
-		virtual Ast::Type  type(void)  const { return Ast::Type::Var;      }
 		virtual Ast::Assoc assoc(void) const { return Ast::Assoc::Non;     }
 		virtual Ast::Prec  prec(void)  const { return Ast::Prec::Symbolic; }
 
-		virtual bool equals(const Ast& b) const {
-			if (b.type() != Ast::Type::Var)
-				return false;
-			return static_cast<const Ast::Var&>(b).var == var;
-		}
+		virtual bool eval_at(const Assignment& assign, size_t) const { return assign[var]; }
 
-		virtual bool eval(const Assignment& assign) const { return assign[var]; }
-
-		/* TODO: the way this is designed makes sharing nodes hard.
-		 * We don't do this at the moment and always allocate. */
-		virtual std::shared_ptr<Ast> simplify(const Assignment& assign) const {
-			if (assign.exists(var))
-				return std::make_shared<Ast::Const>(assign[var]);
-			return std::make_shared<Ast::Var>(var);
-		}
+		bool has_key(VarRef var) const { return this->var == var; }
 
-		virtual std::string to_string(void)  const { return var->to_string(); }
-		virtual std::string to_infix(void)   const { return var->to_string(); }
-		virtual std::string to_prefix(void)  const { return var->to_string(); }
-		virtual std::string to_postfix(void) const { return var->to_string(); }
+		std::string to_string(void) const { return var->to_string(); }
 	};
 
 	class Ast::Not : public Ast {
 	public:
-		std::shared_ptr<Ast> rhs;
+		Ast::Ref rhs;
 
-		Not(std::shared_ptr<Ast> rhs) : rhs(rhs) { }
+		Not(Ast::Ref rhs) : Ast(Ast::Type::Not, hash_of(rhs)), rhs(rhs) { }
+		~Not(void) { release(rhs); }
+
+		static size_t hash_of(const Ast::Ref& rhs) {
+			return Ast::hash_of(Ast::Type::Not, { rhs->hash });
+		}
 
-		virtual Ast::Type  type(void)  const { return Ast::Type::Not;    }
 		virtual Ast::Assoc assoc(void) const { return Ast::Assoc::Non;   }
 		virtual Ast::Prec  prec(void)  const { return Ast::Prec::Notish; }
 
-		virtual bool equals(const Ast& b) const {
-			if (b.type() != Ast::Type::Not)
-				return false;
-			return rhs->equals(*static_cast<const Ast::Not&>(b).rhs);
-		}
+		virtual bool eval_at(const Assignment& assign, size_t d) const { return !rhs->eval_below(assign, d + 1); }
+
+		bool has_key(const Ast::Ref& rhs) const { return this->rhs == rhs; }
+	};
 
-		virtual bool eval(const Assignment& assign) const { return ! rhs->eval(assign); }
+	/** Base class of the binary connectives. */
+	class Ast::Binary : public Ast {
+	public:
+		Ast::Ref lhs;
+		Ast::Ref rhs;
 
-		virtual std::shared_ptr<Ast> simplify(const Assignment& assign) const;
+		Binary(Ast::Type type, size_t hash, Ast::Ref lhs, Ast::Ref rhs) :
+			Ast(type, hash), lhs(lhs), rhs(rhs) { }
+		~Binary(void) { release(lhs); release(rhs); }
 
-		virtual std::string to_infix(void)   const;
-		virtual std::string to_prefix(void)  const;
-		virtual std::string to_postfix(void) const;
+		bool has_key(const Ast::Ref& lhs, const Ast::Ref& rhs) const {
+			return this->lhs == lhs && this->rhs == rhs;
+		}
 	};
 
-	class Ast::And : public Ast {
+	class Ast::And : public Ast::Binary {
 	public:
-		std::shared_ptr<Ast> lhs;
-		std::shared_ptr<Ast> rhs;
+		And(Ast::Ref lhs, Ast::Ref rhs) : Binary(Ast::Type::And, hash_of(lhs, rhs), lhs, rhs) { }
 
-		And(std::shared_ptr<Ast> lhs, std::shared_ptr<Ast> rhs) : lhs(lhs), rhs(rhs) { }
+		static size_t hash_of(const Ast::Ref& lhs, const Ast::Ref& rhs) {
+			return Ast::hash_of(Ast::Type::And, { lhs->hash, rhs->hash });
+		}
 
-		virtual Ast::Type  type(void)  const { return Ast::Type::And;    }
-		virtual Ast::Assoc assoc(void) const { return Ast::Assoc::Both;  }
-		virtual Ast::Prec  prec(void)  const { return Ast::Prec::Andish; }
+		virtual Ast::Assoc assoc(void) const { return Ast::Assoc::Both;   }
+		virtual Ast::Prec  prec(void)  const { return Ast::Prec::Andish;  }
 
-		virtual bool equals(const Ast& b) const {
-			if (b.type() != Ast::Type::And)
-				return false;
-			return lhs->equals(*static_cast<const Ast::And&>(b).lhs)
-			    && rhs->equals(*static_cast<const Ast::And&>(b).rhs);
+		virtual bool eval_at(const Assignment& assign, size_t d) const {
+			return lhs->eval_below(assign, d + 1) && rhs->eval_below(assign, d + 1);
 		}
+	};
 
-		virtual bool eval(const Assignment& assign) const { return lhs->eval(assign) && rhs->eval(assign); }
+	class Ast::Or : public Ast::Binary {
+	public:
+		Or(Ast::Ref lhs, Ast::Ref rhs) : Binary(Ast::Type::Or, hash_of(lhs, rhs), lhs, rhs) { }
 
-		virtual std::shared_ptr<Ast> simplify(const Assignment& assign) const;
+		static size_t hash_of(const Ast::Ref& lhs, const Ast::Ref& rhs) {
+			return Ast::hash_of(Ast::Type::Or, { lhs->hash, rhs->hash });
+		}
 
-		virtual std::string to_infix(void)   const;
-		virtual std::string to_prefix(void)  const;
-		virtual std::string to_postfix(void) const;
+		virtual Ast::Assoc assoc(void) const { return Ast::Assoc::Both;   }
+		virtual Ast::Prec  prec(void)  const { return Ast::Prec::Orish;   }
+
+		virtual bool eval_at(const Assignment& assign, size_t d) const {
+			return lhs->eval_below(assign, d + 1) || rhs->eval_below(assign, d + 1);
+		}
 	};
 
-	class Ast::Or : public Ast {
+	class Ast::Impl : public Ast::Binary {
 	public:
-		std::shared_ptr<Ast> lhs;
-		std::shared_ptr<Ast> rhs;
+		Impl(Ast::Ref lhs, Ast::Ref rhs) : Binary(Ast::Type::Impl, hash_of(lhs, rhs), lhs, rhs) { }
 
-		Or(std::shared_ptr<Ast> lhs, std::shared_ptr<Ast> rhs) : lhs(lhs), rhs(rhs) { }
+		static size_t hash_of(const Ast::Ref& lhs, const Ast::Ref& rhs) {
+			return Ast::hash_of(Ast::Type::Impl, { lhs->hash, rhs->hash });
+		}
 
-		virtual Ast::Type  type(void)  const { return Ast::Type::Or;    }
-		virtual Ast::Assoc assoc(void) const { return Ast::Assoc::Both; }
-		virtual Ast::Prec  prec(void)  const { return Ast::Prec::Orish; }
+		virtual Ast::Assoc assoc(void) const { return Ast::Assoc::Right;  }
+		virtual Ast::Prec  prec(void)  const { return Ast::Prec::Implish; }
 
-		virtual bool equals(const Ast& b) const {
-			if (b.type() != Ast::Type::Or)
-				return false;
-			return lhs->equals(*static_cast<const Ast::Or&>(b).lhs)
-			    && rhs->equals(*static_cast<const Ast::Or&>(b).rhs);
+		virtual bool eval_at(const Assignment& assign, size_t d) const {
+			return !lhs->eval_below(assign, d + 1) || rhs->eval_below(assign, d + 1);
 		}
+	};
 
-		virtual bool eval(const Assignment& assign) const { return lhs->eval(assign) || rhs->eval(assign); }
+	class Ast::Eqv : public Ast::Binary {
+	public:
+		Eqv(Ast::Ref lhs, Ast::Ref rhs) : Binary(Ast::Type::Eqv, hash_of(lhs, rhs), lhs, rhs) { }
+
+		static size_t hash_of(const Ast::Ref& lhs, const Ast::Ref& rhs) {
+			return Ast::hash_of(Ast::Type::Eqv, { lhs->hash, rhs->hash });
+		}
 
-		virtual std::shared_ptr<Ast> simplify(const Assignment& assign) const;
+		virtual Ast::Assoc assoc(void) const { return Ast::Assoc::Both;   }
+		virtual Ast::Prec  prec(void)  const { return Ast::Prec::Eqvish;  }
 
-		virtual std::string to_infix(void)   const;
-		virtual std::string to_prefix(void)  const;
-		virtual std::string to_postfix(void) const;
+		virtual bool eval_at(const Assignment& assign, size_t d) const {
+			return lhs->eval_below(assign, d + 1) == rhs->eval_below(assign, d + 1);
+		}
 	};
 
-	class Ast::Impl : public Ast {
+	class Ast::Xor : public Ast::Binary {
 	public:
-		std::shared_ptr<Ast> lhs;
-		std::shared_ptr<Ast> rhs;
+		Xor(Ast::Ref lhs, Ast::Ref rhs) : Binary(Ast::Type::Xor, hash_of(lhs, rhs), lhs, rhs) { }
 
-		Impl(std::shared_ptr<Ast> lhs, std::shared_ptr<Ast> rhs) : lhs(lhs), rhs(rhs) { }
+		static size_t hash_of(const Ast::Ref& lhs, const Ast::Ref& rhs) {
+			return Ast::hash_of(Ast::Type::Xor, { lhs->hash, rhs->hash });
+		}
 
-		virtual Ast::Type  type(void)  const { return Ast::Type::Impl;    }
-		virtual Ast::Assoc assoc(void) const { return Ast::Assoc::Right;  }
-		virtual Ast::Prec  prec(void)  const { return Ast::Prec::Implish; }
+		virtual Ast::Assoc assoc(void) const { return Ast::Assoc::Both;   }
+		virtual Ast::Prec  prec(void)  const { return Ast::Prec::Xorish;  }
 
-		virtual bool equals(const Ast& b) const {
-			if (b.type() != Ast::Type::Impl)
-				return false;
-			return lhs->equals(*static_cast<const Ast::Impl&>(b).lhs)
-			    && rhs->equals(*static_cast<const Ast::Impl&>(b).rhs);
+		virtual bool eval_at(const Assignment& assign, size_t d) const {
+			return lhs->eval_below(assign, d + 1) != rhs->eval_below(assign, d + 1);
+		}
+	};
+
+	/**
+	 * Base class of the n-ary connectives. They generalize the associative
+	 * binary ones to two or more operands, which are held in a vector, so
+	 * that a long chain is one node instead of a deep spine of binary ones.
+	 * Strings are written as for the right-nested chain of binary nodes,
+	 * which is also what the parser makes of them.
+	 */
+	class Ast::Nary : public Ast {
+	public:
+		std::vector<Ast::Ref> ops;
+
+		Nary(Ast::Type type, size_t hash, std::vector<Ast::Ref>&& ops) : Ast(type, hash), ops(std::move(ops)) { }
+		~Nary(void) {
+			for (auto& op : ops)
+				release(op);
+		}
+
+		static size_t hash_of(Ast::Type type, const std::vector<Ast::Ref>& ops) {
+			size_t seed = Ast::hash_of(type, { ops.size() });
+			for (auto& op : ops)
+				seed ^= op->hash + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+			return seed;
 		}
 
-		virtual bool eval(const Assignment& assign) const { return !lhs->eval(assign) || rhs->eval(assign); }
+		/** The binary connective which this node generalizes. */
+		virtual Ast::Type binary(void) const = 0;
 
-		virtual std::shared_ptr<Ast> simplify(const Assignment& assign) const;
+		virtual Ast::Assoc assoc(void) const { return Ast::Assoc::Both; }
 
-		virtual std::string to_infix(void)   const;
-		virtual std::string to_prefix(void)  const;
-		virtual std::string to_postfix(void) const;
+		bool has_key(const std::vector<Ast::Ref>& ops) const { return this->ops == ops; }
 	};
 
-	class Ast::Eqv : public Ast {
+	class Ast::AndN : public Ast::Nary {
 	public:
-		std::shared_ptr<Ast> lhs;
-		std::shared_ptr<Ast> rhs;
+		AndN(std::vector<Ast::Ref> ops) : Nary(Ast::Type::AndN, hash_of(ops), std::move(ops)) { }
 
-		Eqv(std::shared_ptr<Ast> lhs, std::shared_ptr<Ast> rhs) : lhs(lhs), rhs(rhs) { }
+		static size_t hash_of(const std::vector<Ast::Ref>& ops) {
+			return Nary::hash_of(Ast::Type::AndN, ops);
+		}
 
-		virtual Ast::Type  type(void)  const { return Ast::Type::Eqv;    }
-		virtual Ast::Assoc assoc(void) const { return Ast::Assoc::Both;  }
-		virtual Ast::Prec  prec(void)  const { return Ast::Prec::Eqvish; }
+		virtual Ast::Prec prec(void)   const { return Ast::Prec::Andish; }
+		virtual Ast::Type binary(void) const { return Ast::Type::And;    }
 
-		virtual bool equals(const Ast& b) const {
-			if (b.type() != Ast::Type::Eqv)
-				return false;
-			return lhs->equals(*static_cast<const Ast::Eqv&>(b).lhs)
-			    && rhs->equals(*static_cast<const Ast::Eqv&>(b).rhs);
+		virtual bool eval_at(const Assignment& assign, size_t d) const {
+			for (auto& op : ops) {
+				if (!op->eval_below(assign, d + 1))
+					return false;
+			}
+			return true;
 		}
+	};
+
+	class Ast::OrN : public Ast::Nary {
+	public:
+		OrN(std::vector<Ast::Ref> ops) : Nary(Ast::Type::OrN, hash_of(ops), std::move(ops)) { }
 
-		virtual bool eval(const Assignment& assign) const { return lhs->eval(assign) == rhs->eval(assign); }
+		static size_t hash_of(const std::vector<Ast::Ref>& ops) {
+			return Nary::hash_of(Ast::Type::OrN, ops);
+		}
 
-		virtual std::shared_ptr<Ast> simplify(const Assignment& assign) const;
+		virtual Ast::Prec prec(void)   const { return Ast::Prec::Orish;  }
+		virtual Ast::Type binary(void) const { return Ast::Type::Or;     }
 
-		virtual std::string to_infix(void)   const;
-		virtual std::string to_prefix(void)  const;
-		virtual std::string to_postfix(void) const;
+		virtual bool eval_at(const Assignment& assign, size_t d) const {
+			for (auto& op : ops) {
+				if (op->eval_below(assign, d + 1))
+					return true;
+			}
+			return false;
+		}
 	};
 
-	class Ast::Xor : public Ast {
+	class Ast::XorN : public Ast::Nary {
 	public:
-		std::shared_ptr<Ast> lhs;
-		std::shared_ptr<Ast> rhs;
+		XorN(std::vector<Ast::Ref> ops) : Nary(Ast::Type::XorN, hash_of(ops), std::move(ops)) { }
 
-		Xor(std::shared_ptr<Ast> lhs, std::shared_ptr<Ast> rhs) : lhs(lhs), rhs(rhs) { }
+		static size_t hash_of(const std::vector<Ast::Ref>& ops) {
+			return Nary::hash_of(Ast::Type::XorN, ops);
+		}
 
-		virtual Ast::Type  type(void)  const { return Ast::Type::Xor;    }
-		virtual Ast::Assoc assoc(void) const { return Ast::Assoc::Both;  }
-		virtual Ast::Prec  prec(void)  const { return Ast::Prec::Xorish; }
+		virtual Ast::Prec prec(void)   const { return Ast::Prec::Xorish; }
+		virtual Ast::Type binary(void) const { return Ast::Type::Xor;    }
 
-		virtual bool equals(const Ast& b) const {
-			if (b.type() != Ast::Type::Xor)
-				return false;
-			return lhs->equals(*static_cast<const Ast::Xor&>(b).lhs)
-			    && rhs->equals(*static_cast<const Ast::Xor&>(b).rhs);
+		virtual bool eval_at(const Assignment& assign, size_t d) const {
+			bool v = false;
+			for (auto& op : ops)
+				v ^= op->eval_below(assign, d + 1);
+			return v;
+		}
+	};
+
+	/* These are dispatched on `kind` without a virtual call, because
+	 * traversals call them on every node. */
+	inline size_t Ast::arity(void) const {
+		switch (kind) {
+		case Ast::Type::Const:
+		case Ast::Type::Var:
+			return 0;
+		case Ast::Type::Not:
+			return 1;
+		case Ast::Type::AndN:
+		case Ast::Type::OrN:
+		case Ast::Type::XorN:
+			return static_cast<const Ast::Nary*>(this)->ops.size();
+		default:
+			return 2;
+		}
+	}
+
+	inline const Ast::Ref& Ast::operand(size_t i) const {
+		switch (kind) {
+		case Ast::Type::Not:
+			return static_cast<const Ast::Not*>(this)->rhs;
+		case Ast::Type::AndN:
+		case Ast::Type::OrN:
+		case Ast::Type::XorN:
+			return static_cast<const Ast::Nary*>(this)->ops[i];
+		default:
+			return i ? static_cast<const Ast::Binary*>(this)->rhs : static_cast<const Ast::Binary*>(this)->lhs;
+		}
+	}
+
+	/**
+	 * A post-order traversal of Ast subtrees which works on formulas of
+	 * any depth. Every node is given a result of type R, computed from
+	 * the results of its operands. Shared subtrees are visited once per
+	 * occurrence. Since results are passed as an array, R should not be
+	 * bool.
+	 *
+	 * The top Ast::RECURSION levels of the subtree are traversed
+	 * recursively, which is fastest on the shallow formulas that are
+	 * most common. Deeper subtrees are traversed by a loop which keeps
+	 * its stack on the heap. The stacks are kept between runs, so that
+	 * an object which is used repeatedly does not allocate once they
+	 * have grown.
+	 */
+	template<typename R>
+	class Ast::PostOrder {
+		struct Frame {
+			const Ast* node;
+			size_t arity;
+			/* Index of the result of its first operand. */
+			size_t base;
+		};
+		std::vector<Frame> frames;
+		std::vector<R> results;
+
+		/* Traverse below an entered node with operands. */
+		template<typename Visit, typename Enter, typename Cut>
+		R recurse(const Ast* node, size_t arity, size_t depth, Visit& visit, Enter& enter, Cut& cut) {
+			if (depth >= RECURSION)
+				return iterate(node, arity, visit, enter, cut);
+
+			/* Binary and unary nodes, the common case, keep the results
+			 * of their operands in the stack frame. */
+			if (arity <= 2) {
+				R local[2];
+				size_t done = 0;
+				for (; done < arity; ++done) {
+					if (done && cut(node, local, done))
+						break;
+					const Ast* op = node->operand(done).get();
+					const size_t n = op->arity();
+					local[done] = enter(op, node, done) && n ?
+						recurse(op, n, depth + 1, visit, enter, cut) :
+						visit(op, results.data() + results.size(), 0);
+				}
+				return visit(node, local, done);
+			}
+
+			const size_t base = results.size();
+			size_t done = 0;
+			for (; done < arity; ++done) {
+				if (done && cut(node, results.data() + base, done))
+					break;
+				const Ast* op = node->operand(done).get();
+				const size_t n = op->arity();
+				R r = enter(op, node, done) && n ?
+					recurse(op, n, depth + 1, visit, enter, cut) :
+					visit(op, results.data() + results.size(), 0);
+				results.push_back(std::move(r));
+			}
+
+			R r = visit(node, results.data() + base, done);
+			results.resize(base);
+			return r;
 		}
 
-		virtual bool eval(const Assignment& assign) const { return lhs->eval(assign) != rhs->eval(assign); }
+		/* The same with the stack on the heap. */
+		template<typename Visit, typename Enter, typename Cut>
+		R iterate(const Ast* root, size_t arity, Visit& visit, Enter& enter, Cut& cut) {
+			frames.push_back(Frame{ root, arity, results.size() });
+			while (true) {
+				const Frame f = frames.back();
+				const size_t done = results.size() - f.base;
+				if (done < f.arity && !(done && cut(f.node, results.data() + f.base, done))) {
+					/* Leaves are visited right away. */
+					const Ast* op = f.node->operand(done).get();
+					const size_t n = op->arity();
+					if (enter(op, f.node, done) && n)
+						frames.push_back(Frame{ op, n, results.size() });
+					else
+						results.push_back(visit(op, results.data() + results.size(), 0));
+					continue;
+				}
+
+				R r = visit(f.node, results.data() + f.base, done);
+				results.resize(f.base);
+				frames.pop_back();
+				if (frames.empty())
+					return r;
+				results.push_back(std::move(r));
+			}
+		}
 
-		virtual std::shared_ptr<Ast> simplify(const Assignment& assign) const;
+	public:
+		/** The default `enter` which visits all operands. */
+		struct Descend {
+			bool operator()(const Ast*, const Ast*, size_t) const { return true; }
+		};
+
+		/** The default `cut` which never skips operands. */
+		struct Continue {
+			bool operator()(const Ast*, const R*, size_t) const { return false; }
+		};
 
-		virtual std::string to_infix(void)   const;
-		virtual std::string to_prefix(void)  const;
-		virtual std::string to_postfix(void) const;
+		/**
+		 * Traverse the subtree at `root` and return its result.
+		 *
+		 * `enter(node, parent, i)` is called first on every node, which
+		 * is operand i of `parent` or the root if that is null. If it
+		 * returns false, the operands of the node are not visited.
+		 * Before operand i > 0 of a node is visited, `cut(node, results,
+		 * i)` may decide, given the results of the first i operands, to
+		 * skip the rest. Finally, `visit(node, results, n)` returns the
+		 * result of the node from those of the first n operands, which
+		 * are all of them unless the node was entered without descending
+		 * or cut short.
+		 */
+		template<typename Visit, typename Enter = Descend, typename Cut = Continue>
+		R run(const Ast* root, Visit&& visit, Enter&& enter = Enter(), Cut&& cut = Cut()) {
+			frames.clear();
+			results.clear();
+			const size_t arity = root->arity();
+			if (!enter(root, nullptr, 0) || !arity)
+				return visit(root, results.data(), 0);
+			return recurse(root, arity, 0, visit, enter, cut);
+		}
 	};
+
+	/**
+	 * The unique table of all live nodes created by Ast::make. Nodes are
+	 * found by their structural hash and then compared by the identities
+	 * of their operands.
+	 *
+	 * The table only holds weak references, entries of destroyed nodes are
+	 * swept out whenever the table doubled in size, and it is locked. If
+	 * the library is built with PROPCALC_SINGLE_THREADED, the buckets are
+	 * instead chained through the nodes, which unlink themselves when they
+	 * are destroyed, so that an entry costs no more than a pointer.
+	 */
+	class Ast::Table {
+#ifdef PROPCALC_SINGLE_THREADED
+		/* The array is never freed, so that nodes in static objects can
+		 * still be destroyed at exit. */
+		Ast** buckets = nullptr;
+		/* The number of buckets minus one. */
+		size_t mask = 0;
+		size_t count = 0;
+
+		void grow(void);
+#else
+		std::mutex access;
+		std::unordered_multimap<size_t, std::weak_ptr<Ast>,
+			std::hash<size_t>, std::equal_to<size_t>,
+			Pool::Allocator<std::pair<const size_t, std::weak_ptr<Ast>>>> nodes;
+		size_t threshold = 1024;
+
+		/* Needs the lock to be held! */
+		void sweep(void);
+#endif
+
+		static bool is_interned(bool)                { return true;         }
+		static bool is_interned(VarRef)              { return true;         }
+		static bool is_interned(const Ast::Ref& op)  { return op->interned; }
+
+		static bool is_interned(const std::vector<Ast::Ref>& ops) {
+			for (auto& op : ops) {
+				if (!op->interned)
+					return false;
+			}
+			return true;
+		}
+
+	public:
+#ifdef PROPCALC_SINGLE_THREADED
+		/** Number of live nodes in the table. */
+		size_t size(void) { return count; }
+
+		/** Remove a node which is being destroyed, if it is in the table. */
+		void unlink(Ast* node);
+
+		template<typename T, typename... Args>
+		Ast::Ref intern(Args&&... args) {
+			if (!buckets || count > mask)
+				grow();
+
+			size_t hash = T::hash_of(args...);
+			Ast*& head = buckets[hash & mask];
+			for (Ast* node = head; node; node = node->next_entry) {
+				if (node->hash == hash && typeid(*node) == typeid(T) &&
+						static_cast<const T*>(node)->has_key(args...))
+					return Ast::Ref(node);
+			}
+
+			bool interned = (is_interned(args) && ...);
+			auto node = Ast::fresh<T>(std::forward<Args>(args)...);
+			node->interned = interned;
+			node->next_entry = head;
+			head = node.get();
+			count++;
+			return node;
+		}
+#else
+		/** Number of entries, including those of destroyed nodes. */
+		size_t size(void);
+
+		template<typename T, typename... Args>
+		Ast::Ref intern(Args&&... args) {
+			size_t hash = T::hash_of(args...);
+
+			const std::lock_guard<std::mutex> lock(access);
+			auto range = nodes.equal_range(hash);
+			auto slot = nodes.end();
+			for (auto it = range.first; it != range.second; ++it) {
+				auto node = it->second.lock();
+				if (!node) {
+					slot = it;
+					continue;
+				}
+				if (typeid(*node) == typeid(T) && static_cast<const T*>(node.get())->has_key(args...))
+					return node;
+			}
+
+			bool interned = (is_interned(args) && ...);
+			auto node = Ast::fresh<T>(std::forward<Args>(args)...);
+			node->interned = interned;
+			/* Reuse the entry of a destroyed node if possible. */
+			if (slot != nodes.end()) {
+				slot->second = node;
+			}
+			else {
+				nodes.insert({ hash, node });
+				if (nodes.size() > threshold)
+					sweep();
+			}
+			return node;
+		}
+#endif
+	};
+
+	template<typename T, typename... Args>
+	Ast::Ref Ast::make(Args&&... args) {
+		return Ast::table.intern<T>(std::forward<Args>(args)...);
+	}
 }
 
 #endif /* PROPCALC_AST_HPP */
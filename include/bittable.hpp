@@ -0,0 +1,133 @@
+/*
+ * bittable.hpp - Bittable, truth table as a packed bit vector
+ *
+ * Copyright (C) 2020 Tobias Boege
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the Artistic License 2.0
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ */
+
+#ifndef PROPCALC_BITTABLE_HPP
+#define PROPCALC_BITTABLE_HPP
+
+#include <vector>
+#include <cstdint>
+#include <iterator>
+
+#include <propcalc/domain.hpp>
+#include <propcalc/assignment.hpp>
+
+namespace Propcalc {
+	class Formula;
+
+	/**
+	 * A Bittable holds the entire truth table of a Formula as a packed
+	 * vector of 2^n bits, where n is the number of variables. Bit r is
+	 * the value of the formula on row r of the truth table, in the same
+	 * order as the Truthtable stream: slot i of the variables in
+	 * `Formula::vars()` order has the value of bit i of r.
+	 *
+	 * The table is computed by bit-sliced evaluation, see CompiledFormula.
+	 * Iterating over a Bittable yields the numbers of the satisfying rows
+	 * in ascending order.
+	 */
+	class Bittable {
+		std::vector<VarRef> order;
+		std::vector<uint64_t> bits;
+		uint64_t rows;
+
+	public:
+		/**
+		 * Compute the truth table of the formula. An std::length_error
+		 * is thrown if it has 64 or more variables.
+		 */
+		Bittable(const Formula& fm);
+
+		/** The variables in slot order. This is the same as `Formula::vars()`. */
+		const std::vector<VarRef>& vars(void) const { return order; }
+
+		/**
+		 * The packed table. Bit r is in bit `r % 64` of word `r / 64`.
+		 * Bits past the last row in the last word are zero.
+		 */
+		const std::vector<uint64_t>& words(void) const { return bits; }
+
+		/** The number of rows, 2^n. */
+		uint64_t size(void) const { return rows; }
+
+		/** The number of satisfying rows. */
+		uint64_t count(void) const;
+
+		/** The value of the formula on row r. */
+		bool operator[](uint64_t r) const {
+			return (bits[r / 64] >> (r % 64)) & 1;
+		}
+
+		/**
+		 * The value of the formula on an Assignment. It must be defined
+		 * on all variables, otherwise an std::out_of_range exception is
+		 * thrown.
+		 */
+		bool eval(const Assignment& assign) const {
+			return operator[](rank(assign));
+		}
+
+		/** The row number of an assignment. The same comments as for `eval` apply. */
+		uint64_t rank(const Assignment& assign) const { return assign.rank(order); }
+		/** The assignment in row r. */
+		Assignment unrank(uint64_t r) const { return Assignment(order, r); }
+
+		/** The first satisfying row at or after r, or `size()` if none exists. */
+		uint64_t next(uint64_t r) const;
+
+		/** Iterator over the satisfying rows. */
+		class iterator {
+			const Bittable* bt;
+			uint64_t r;
+
+		public:
+			using iterator_category = std::forward_iterator_tag;
+			using value_type        = uint64_t;
+			using difference_type   = std::ptrdiff_t;
+			using pointer           = const uint64_t*;
+			using reference         = uint64_t;
+
+			iterator(const Bittable* bt, uint64_t r) : bt(bt), r(r) { }
+
+			uint64_t operator*(void) const { return r; }
+
+			iterator& operator++(void) {
+				r = bt->next(r + 1);
+				return *this;
+			}
+
+			iterator operator++(int) {
+				iterator tmp(*this);
+				operator++();
+				return tmp;
+			}
+
+			bool operator==(const iterator& rhs) const { return r == rhs.r; }
+			bool operator!=(const iterator& rhs) const { return r != rhs.r; }
+		};
+
+		iterator begin(void) const { return iterator(this, next(0)); }
+		iterator end(void)   const { return iterator(this, rows); }
+
+		/** Two Bittables are equal if they have the same variables and values. */
+		bool operator==(const Bittable& rhs) const {
+			return order == rhs.order && bits == rhs.bits;
+		}
+
+		bool operator!=(const Bittable& rhs) const {
+			return !(*this == rhs);
+		}
+	};
+}
+
+#endif /* PROPCALC_BITTABLE_HPP */
@@ -0,0 +1,87 @@
+/*
+ * clausebuf.hpp - ClauseBuffer, queue of clauses in packed storage
+ *
+ * Copyright (C) 2020 Tobias Boege
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the Artistic License 2.0
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ */
+
+#ifndef PROPCALC_CLAUSEBUF_HPP
+#define PROPCALC_CLAUSEBUF_HPP
+
+#include <vector>
+#include <cstdint>
+#include <initializer_list>
+
+#include <propcalc/domain.hpp>
+#include <propcalc/conjunctive.hpp>
+
+namespace Propcalc {
+	/**
+	 * A first-in first-out queue of clauses for the streams which make
+	 * several clauses at once. All clauses live in one vector of literals,
+	 * each packed into a word as the address of its variable with the
+	 * sign in the lowest bit, which is free because Variable objects are
+	 * aligned. A clause is read by copying it into an existing Clause
+	 * object, such as the current value of a Stream.
+	 *
+	 * The storage is reset, keeping its capacity, whenever the queue
+	 * runs empty, so a stream which alternates between filling and
+	 * draining it does not allocate once the buffer has grown.
+	 */
+	class ClauseBuffer {
+		std::vector<uintptr_t> lits;
+		/* Offset of the first literal of each clause in `lits`. */
+		std::vector<size_t> starts;
+		size_t head = 0;
+
+		static uintptr_t pack(VarRef v, bool sign) {
+			return reinterpret_cast<uintptr_t>(v) | sign;
+		}
+
+	public:
+		/** Whether there is no clause to pop. */
+		bool empty(void) const { return head == starts.size(); }
+
+		/** The number of clauses to pop. */
+		size_t size(void) const { return starts.size() - head; }
+
+		/** Append a clause. */
+		void push(std::initializer_list<std::pair<VarRef, bool>> il) {
+			starts.push_back(lits.size());
+			for (auto& [v, sign] : il)
+				lits.push_back(pack(v, sign));
+		}
+
+		/** Append a clause. */
+		void push(const Clause& cl) {
+			starts.push_back(lits.size());
+			for (size_t i = 0; i < cl.size(); ++i)
+				lits.push_back(pack(cl.vars()[i], cl.value(i)));
+		}
+
+		/**
+		 * Remove the first clause and store it in `cl`, reusing its
+		 * storage. The queue must not be empty.
+		 */
+		void pop(Clause& cl) {
+			const size_t end = head + 1 < starts.size() ? starts[head + 1] : lits.size();
+			cl.clear();
+			for (size_t i = starts[head]; i < end; ++i)
+				cl[reinterpret_cast<VarRef>(lits[i] & ~uintptr_t(1))] = lits[i] & 1;
+			if (++head == starts.size()) {
+				lits.clear();
+				starts.clear();
+				head = 0;
+			}
+		}
+	};
+}
+
+#endif /* PROPCALC_CLAUSEBUF_HPP */
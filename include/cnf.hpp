@@ -15,33 +15,75 @@
 #ifndef PROPCALC_CNF_HPP
 #define PROPCALC_CNF_HPP
 
+#include <set>
 #include <queue>
+#include <vector>
 #include <memory>
+#include <optional>
+#include <cstdint>
 
 #include <propcalc/ast.hpp>
 #include <propcalc/assignment.hpp>
 #include <propcalc/conjunctive.hpp>
+#include <propcalc/clausebuf.hpp>
 #include <propcalc/formula.hpp>
+#include <propcalc/compiled.hpp>
 
 namespace Propcalc {
 	/**
 	 * This stream takes a Formula and lazily enumerates the clauses of
 	 * an equivalent formula in conjunctive normal form.
 	 *
-	 * It does this by first skipping all Ast::And nodes at the root
-	 * recursively collecting their non-And children. Concatenating the
-	 * CNFs of these children yields a CNF of the entire. Then the
-	 * truthtable of each child is enumerated: every non-satisfying
-	 * assignment becomes one clause forbidding that assignment.
+	 * It does this by first skipping all Ast::And and Ast::AndN nodes
+	 * at the root recursively collecting their non-And children.
+	 * Concatenating the CNFs of these children yields a CNF of the
+	 * entire. Then the truthtable of each child is enumerated: every
+	 * non-satisfying assignment becomes one clause forbidding that
+	 * assignment.
+	 *
+	 * Conjuncts which are already clauses, that is disjunctions of
+	 * literals and constants, are emitted directly. Tautologies and
+	 * repeated clauses among them are left out.
+	 *
+	 * The truthtables are enumerated in Gray code order with incremental
+	 * evaluation, like Truthtable in Gray mode. The clauses of each child
+	 * come in this order.
 	 */
 	class CNF : public Conjunctive {
 		Formula fm;
-		std::queue<std::shared_ptr<Ast>> queue;
-		std::shared_ptr<Ast> current = nullptr;
+		std::queue<Ast::Ref> queue;
+		Ast::Ref current = nullptr;
 		Assignment last;
+		std::optional<CompiledFormula::Incremental> incr;
+		uint64_t row = 0;
+		/* The number of rows of `current`, or UINT64_MAX if that does not fit. */
+		uint64_t stop = UINT64_MAX;
+
+		/* Minimized clauses of `current` which are yet to come. */
+		bool minimize;
+		ClauseBuffer pending;
+
+		/* Whether `current` is done once the last clause is read. */
+		bool finished = false;
+		/* Clauses emitted directly, to skip repeats. */
+		std::set<std::pair<std::vector<VarRef>, std::vector<uint64_t>>> emitted;
 
 	public:
-		CNF(const Formula& fm);
+		/**
+		 * The stream produces its first clause on construction, so
+		 * caching must be decided here for the cache to be complete.
+		 * In minimizing mode, see Minimize::cnf, each conjunct on up
+		 * to Minimize::MAX_VARS variables is replaced by a small set
+		 * of prime implicates instead of one clause per falsifying
+		 * assignment.
+		 */
+		CNF(const Formula& fm, bool caching = false, bool minimize = false);
+
+		/**
+		 * The maximal subtrees of the formula without an And at the
+		 * root, from left to right. Their CNFs are concatenated.
+		 */
+		static std::vector<Ast::Ref> conjuncts(const Formula& fm);
 
 		operator bool(void) const {
 			return queue.size() > 0 || current != nullptr;
@@ -0,0 +1,160 @@
+/*
+ * compiled.hpp - CompiledFormula, flat representation for evaluation
+ *
+ * Copyright (C) 2020 Tobias Boege
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the Artistic License 2.0
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ */
+
+#ifndef PROPCALC_COMPILED_HPP
+#define PROPCALC_COMPILED_HPP
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include <propcalc/ast.hpp>
+#include <propcalc/domain.hpp>
+#include <propcalc/assignment.hpp>
+
+namespace Propcalc {
+	class Formula;
+
+	/**
+	 * A CompiledFormula is a flattened copy of a Formula which is cheap
+	 * to evaluate many times. The AST is stored as a contiguous array of
+	 * instructions in post-order. Shared subformulas are compiled only
+	 * once. Variables are resolved to dense slot numbers which are their
+	 * indices in `Formula::vars()`, so that an assignment is just a bit
+	 * vector.
+	 *
+	 * Evaluation works on an array of values whose first entries are
+	 * the values of the slots, followed by one entry per instruction.
+	 * Instructions refer to their operands by index into this array.
+	 *
+	 * Evaluation does not short-circuit and requires a value for every
+	 * variable. On total assignments, the result is the same as that of
+	 * `Formula::eval`.
+	 */
+	class CompiledFormula {
+	public:
+		/**
+		 * One instruction of the program. It computes the connective
+		 * `op` of the values at indices `a` and `b`. Unary connectives
+		 * have `a == b` and constants refer to index 0. The instruction
+		 * is also given by its truth `table`: its value is the bit at
+		 * position `2*A + B` where A, B are the operand values.
+		 *
+		 * Variables do not become instructions, unless the entire formula
+		 * is a single variable: then it is copied by an instruction with
+		 * op Ast::Type::Var.
+		 */
+		struct Instr {
+			Ast::Type op;
+			unsigned char table;
+			unsigned int a, b;
+		};
+
+	private:
+		std::vector<VarRef> slots;
+		std::vector<Instr> code;
+
+	public:
+		CompiledFormula(const Formula& fm);
+
+		/** The variables in slot order. This is the same as `Formula::vars()`. */
+		const std::vector<VarRef>& vars(void) const { return slots; }
+
+		/**
+		 * The program. Its last instruction computes the formula's value.
+		 * The value of instruction i is at index `vars().size() + i`.
+		 */
+		const std::vector<Instr>& program(void) const { return code; }
+
+		/** Evaluate on a bit vector indexed by slot number. */
+		bool eval(const std::vector<bool>& bits) const;
+
+		/**
+		 * Evaluate on an Assignment. It must be defined on all variables,
+		 * otherwise an std::out_of_range exception is thrown.
+		 */
+		bool eval(const Assignment& assign) const;
+
+		/**
+		 * Bit-sliced evaluation of 64 * `words` assignments at once. The
+		 * `slices` array holds `words` consecutive 64-bit words for each
+		 * slot, in slot order. Bit j of word k of a slot is its value in
+		 * assignment 64*k + j. The formula's values are written to `out`
+		 * in the same layout.
+		 *
+		 * Each connective is one bitwise operation per word. Depending on
+		 * the CPU, 4 or 8 words are processed by one AVX2 or AVX-512
+		 * instruction. This is decided at runtime.
+		 */
+		void eval_sliced(const uint64_t* slices, uint64_t* out, unsigned int words) const;
+
+		/**
+		 * Evaluate the rows `first, ..., first + 64 * words - 1` of the
+		 * truth table, where `first` must be divisible by 64. The number
+		 * of a row is the rank of its assignment in the order produced
+		 * by Assignment::operator++: slot i has the value of bit i of
+		 * the row number. Rows past the end of the truth table repeat it.
+		 */
+		void eval_rows(uint64_t first, uint64_t* out, unsigned int words) const;
+
+		/**
+		 * The number of 64-bit words which the CPU evaluates in one
+		 * instruction: 1, 4 (with AVX2) or 8 (with AVX-512).
+		 */
+		static unsigned int native_words(void);
+
+		class Incremental;
+	};
+
+	/**
+	 * Incremental evaluation of a CompiledFormula. The values of all
+	 * instructions are kept, starting from the all-false assignment.
+	 * Flipping a variable re-evaluates only its fan-out cone, that is
+	 * the instructions which depend on it, in program order.
+	 *
+	 * Copies share the program and the cones, but not the values. The
+	 * cones are found by one pass over the program per variable, which
+	 * is as slow as that many evaluations.
+	 */
+	class CompiledFormula::Incremental {
+		std::shared_ptr<const CompiledFormula> cf;
+		/* The instructions in the cone of each slot, in program order. */
+		std::shared_ptr<const std::vector<std::vector<unsigned int>>> cones;
+		std::vector<unsigned char> v;
+
+		void eval_instr(unsigned int i) {
+			const Instr& c = cf->code[i];
+			v[cf->slots.size() + i] = (c.table >> (v[c.a] << 1 | v[c.b])) & 1;
+		}
+
+	public:
+		Incremental(std::shared_ptr<const CompiledFormula> cf);
+
+		/** The current value of the variable in a slot. */
+		bool operator[](size_t slot) const { return v[slot]; }
+
+		/** The value of the formula on the current assignment. */
+		bool value(void) const { return v.back(); }
+
+		/** Flip the variable in a slot and return the new value of the formula. */
+		bool flip(size_t slot) {
+			v[slot] ^= 1;
+			for (auto i : (*cones)[slot])
+				eval_instr(i);
+			return value();
+		}
+	};
+}
+
+#endif /* PROPCALC_COMPILED_HPP */
@@ -37,13 +37,26 @@ namespace Propcalc {
 		/** Initialize the mapping with the given data. */
 		Clause(std::initializer_list<std::pair<VarRef, bool>> il) : VarMap(il) { }
 		/** Initialize the clause from a VarMap object. */
-		Clause(VarMap&& vm) : VarMap(vm) { }
+		Clause(VarMap&& vm) : VarMap(std::move(vm)) { }
+
+		/**
+		 * Make this the clause which forbids the given assignment, that
+		 * is its negation. The storage of this object is reused.
+		 */
+		Clause& forbid(const VarMap& assign) {
+			VarMap::operator=(assign);
+			for (auto& w : bits)
+				w = ~w;
+			mask_tail();
+			return *this;
+		}
 
 		/** Flip all signs in the clause. */
 		Clause operator~(void) const {
-			Clause neg(order);
-			for (auto& v : order)
-				neg[v] = !vmap.at(v);
+			Clause neg(*this);
+			for (auto& w : neg.bits)
+				w = ~w;
+			neg.mask_tail();
 			return neg;
 		}
 
@@ -57,8 +70,13 @@ namespace Propcalc {
 		 * element with respect to disjunction).
 		 */
 		bool eval(const Assignment& assign) const {
-			for (auto v : assign.vars()) {
-				if (exists(v) && (*this)[v] == assign[v])
+			/* Look up the variables of the smaller map in the larger. */
+			const VarMap& cl = *this;
+			const VarMap& small = size() <= assign.size() ? cl : assign;
+			const VarMap& large = size() <= assign.size() ? assign : cl;
+			for (size_t i = 0; i < small.size(); ++i) {
+				size_t j = large.position(small.vars()[i]);
+				if (j != npos && small.value(i) == large.value(j))
 					return true;
 			}
 			return false;
@@ -70,7 +88,7 @@ namespace Propcalc {
 		std::ostream& operator<<(std::ostream& os, const Clause& cl) {
 			os << "{ ";
 			for (auto& v : cl.vars())
-				os << (cl[v] ? "" : "-") << v->name << " ";
+				os << (cl[v] ? "" : "-") << v->get_name() << " ";
 			return os << "}";
 		}
 	}
@@ -19,6 +19,7 @@
 #include <memory>
 #include <vector>
 #include <mutex>
+#include <atomic>
 #include <stdexcept>
 #include <algorithm>
 #include <unordered_map>
@@ -29,16 +30,27 @@ namespace Propcalc {
 	 * A propositional variable in libpropcalc is an object derived from the
 	 * Variable class. It needs at least a name, which uniquely identifies
 	 * it in its Domain.
+	 *
+	 * Derived classes may compute the name only when it is first asked
+	 * for by overriding `get_name`. For such a variable, the `name` field
+	 * is empty until then, so use `get_name` unless you know better.
 	 */
+	class Cache;
+
 	class Variable {
 	public:
-		std::string name;
+		mutable std::string name;
+
+		/** The Cache which owns the variable and its number there, see Cache::pack. */
+		const Cache* owner = nullptr;
+		unsigned int number = 0;
 
 		Variable(std::string name) : name(name) { }
 		Variable(const char* s, size_t len) : name(s, len) { }
 		virtual ~Variable(void) { }
 
-		virtual std::string to_string(void) const { return "[" + name + "]"; }
+		virtual const std::string& get_name(void) const { return name; }
+		virtual std::string to_string(void) const { return "[" + get_name() + "]"; }
 	};
 
 	/**
@@ -86,10 +98,23 @@ namespace Propcalc {
 	 */
 	class Domain {
 	public:
-		virtual std::string name(VarRef var) { return var->name; }
+		virtual std::string name(VarRef var) { return var->get_name(); }
 
 		/** Return a variable from its name. */
 		virtual VarRef resolve(std::string name) = 0;
+
+		/**
+		 * Return the variable of the given name if it exists, otherwise
+		 * nullptr. Unlike `resolve`, this never creates a variable. The
+		 * default looks through `list`.
+		 */
+		virtual VarRef lookup(const std::string& name) {
+			for (auto var : list()) {
+				if (this->name(var) == name)
+					return var;
+			}
+			return nullptr;
+		}
 		/** Convert a variable to its 1-based ID number. */
 		virtual VarNr  pack(VarRef var)          = 0;
 		/** Convert a variable number to the object. */
@@ -137,8 +162,17 @@ namespace Propcalc {
 	 * of this name will return the same variable object.
 	 *
 	 * Variable numbers are then just (shifted, 1-based) indices of the
-	 * objects in the cache. The `pack` and `unpack` methods have their
-	 * own redundant caches to make each lookup amortized constant time.
+	 * objects in the cache. The `pack` and `unpack` lookups take constant
+	 * time and `resolve` amortized constant time.
+	 *
+	 * Lookups of existing variables by `resolve`, `pack` and `unpack` do
+	 * not lock, so that threads sharing a Cache do not serialize on it.
+	 * Only the creation of variables takes the lock. The variables by
+	 * number are kept in chunks which never move, the VarNr of a variable
+	 * is stored in it, and the names are in an open addressing table
+	 * which is only ever added to. When the table grows, the new one is
+	 * published atomically and the old one is kept until the Cache is
+	 * destroyed, since readers may still be probing it.
 	 *
 	 * A request to `unpack` a high variable number will result in all the
 	 * missing variables to be allocated. Their names are just the decimal
@@ -153,20 +187,52 @@ namespace Propcalc {
 	class Cache : public Domain {
 	private:
 		std::vector<std::unique_ptr<Variable>> cache;
-		std::unordered_map<std::string, VarRef> by_name;
-		std::vector<VarRef> by_nr;
-		std::unordered_map<VarRef, VarNr> by_ref;
 		bool frozen = false;
 
+		/* Chunk k holds BASE * 2^k variables in the order of their VarNr. */
+		static constexpr size_t BASE = 64;
+		static constexpr size_t CHUNKS = 32;
+		std::unique_ptr<VarRef[]> by_nr[CHUNKS];
+		/* Number of variables whose entries in `by_nr` are complete. */
+		std::atomic<size_t> count{0};
+
+		static size_t chunk(size_t i);
+		VarRef& at(size_t i) const;
+
+		/* Table of named variables. A slot's hash is written before its variable. */
+		struct Names {
+			struct Slot {
+				std::atomic<VarRef> var{nullptr};
+				size_t hash;
+			};
+			size_t mask;
+			size_t used = 0;
+			std::unique_ptr<Slot[]> slots;
+
+			Names(size_t size) : mask(size - 1), slots(new Slot[size]) { }
+		};
+		std::atomic<Names*> by_name{nullptr};
+		/* The current table and all previous ones. */
+		std::vector<std::unique_ptr<Names>> tables;
+
+		VarRef find(const std::string& name, size_t hash) const;
+		void insert(VarRef var, size_t hash);
+
 	protected:
 		mutable std::mutex access;
 		std::pair<VarNr, VarRef> new_variable(std::string name);
-		std::pair<VarNr, VarRef> put_variable(std::unique_ptr<Variable> uvar);
+		/**
+		 * Take ownership of a new variable. If `named` is false, it is not
+		 * entered into the lookup by name, so that a lazy name does not
+		 * have to be computed. `resolve` must then be overridden to find it.
+		 */
+		std::pair<VarNr, VarRef> put_variable(std::unique_ptr<Variable> uvar, bool named = true);
 
 	public:
 		virtual ~Cache(void) { }
 
 		virtual VarRef resolve(std::string name);
+		virtual VarRef lookup(const std::string& name);
 		virtual VarNr  pack(VarRef var);
 		virtual VarRef unpack(VarNr nr);
 
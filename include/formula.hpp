@@ -56,18 +56,25 @@ namespace Propcalc {
 
 	class Truthtable;
 	class Tseitin;
+	class Hybrid;
 	class CNF;
+	class CompiledFormula;
+	class Bittable;
+#ifndef PROPCALC_SINGLE_THREADED
+	class ParallelTruthtable;
+	class ParallelCNF;
+#endif
 
 	/**
 	 * A Formula object represents a memory-managed formula. It consists
-	 * of a shared_ptr to the root AST node and to a Domain object which
+	 * of an Ast::Ref to the root AST node and to a Domain object which
 	 * the internals consult when they need information about variables
 	 * appearing in the formula.
 	 */
 	class Formula {
 	public:
 		Domain* domain;
-		std::shared_ptr<Ast> root;
+		Ast::Ref root;
 
 		/**
 		 * DefaultDomain is the default global domain for variables used
@@ -79,9 +86,9 @@ namespace Propcalc {
 		Formula(const std::string& fm, Domain* domain = &DefaultDomain);
 
 		/** Wrap existing AST in a formula. */
-		Formula(std::shared_ptr<Ast> root, Domain* domain = &DefaultDomain) :
+		Formula(Ast::Ref root, Domain* domain = &DefaultDomain) :
 			domain(domain),
-			root(root)
+			root(std::move(root))
 		{ }
 
 		/**
@@ -99,13 +106,15 @@ namespace Propcalc {
 		 * Formula constructor applied to an individual clause. If the
 		 * conjunctive has no element, the constructed formula consists of
 		 * a single Ast::Const node, which is true (true being the identity
-		 * element with respect to conjunction).
+		 * element with respect to conjunction). Clauses and the conjunction
+		 * are n-ary nodes, so a large CNF does not make a deep AST.
 		 */
 		Formula(Conjunctive& clauses, Domain* domain);
 
 		/**
 		 * Return all variables appearing in the formula sorted in ascending
-		 * order by their `Domain.pack` value.
+		 * order by their `Domain.pack` value. Each node of the formula is
+		 * looked at once, however often it is shared.
 		 */
 		std::vector<VarRef> vars(void) const;
 
@@ -124,23 +133,64 @@ namespace Propcalc {
 		 */
 		Formula simplify(void) const { return simplify(Assignment()); }
 		Formula simplify(const Assignment& assign) const {
-			return Formula(root->simplify(assign), domain);
+			return Formula(Ast::simplify(root, assign), domain);
 		}
 
-		/** Return a Truthtable stream for the formula. */
-		Truthtable truthtable(bool caching = false) const;
-		/** Return a Tseitin transform stream for the formula. */
-		Tseitin    tseitin(bool caching = false) const;
-		/** Return a CNF stream for the formula. */
-		CNF        cnf(bool caching = false) const;
+		/**
+		 * Return an equivalent formula in which the chains of binary
+		 * conjunctions, disjunctions and exclusive ors are merged into
+		 * n-ary nodes. See Ast::flatten.
+		 */
+		Formula flatten(void) const {
+			return Formula(Ast::flatten(root), domain);
+		}
+
+		/** Return a Truthtable stream for the formula, optionally in sliced mode. */
+		Truthtable truthtable(bool caching = false, bool sliced = false) const;
+		/** Return a Truthtable stream for the formula in Gray mode. */
+		Truthtable truthtable_gray(bool caching = false) const;
+		/** Return a Tseitin transform stream for the formula, optionally polarity-aware. */
+		Tseitin    tseitin(bool caching = false, bool polarity = false) const;
+		/** Return a stream which mixes CNF and Tseitin within a clause budget per conjunct. */
+		Hybrid     hybrid(uint64_t budget = 64, bool caching = false) const;
+		/** Return a CNF stream for the formula, optionally in minimizing mode. */
+		CNF        cnf(bool caching = false, bool minimize = false) const;
+#ifndef PROPCALC_SINGLE_THREADED
+		/**
+		 * Return a CNF stream for the formula which converts its conjuncts
+		 * on `threads` threads. Not available in the single-threaded build.
+		 */
+		ParallelCNF cnf_parallel(unsigned int threads = 0, bool ordered = true,
+			bool caching = false, bool minimize = false) const;
+#endif
+
+		/** Return a CompiledFormula for fast repeated evaluation. */
+		CompiledFormula compile(void) const;
+		/** Return the whole truth table as a packed bit vector. */
+		Bittable truthtable_bits(void) const;
+#ifndef PROPCALC_SINGLE_THREADED
+		/**
+		 * Return a driver running through the truth table on `threads`
+		 * threads. Not available in the single-threaded build.
+		 */
+		ParallelTruthtable truthtable_parallel(unsigned int threads = 0) const;
+#endif
 
 		/** Return an infix stringification of the formula using a minimal amount of parenthesis. */
 		std::string to_infix(void)   const { return root->to_infix();   }
-		/** Return the postfix (reverse polish notation) stringification of the formula. */
-		std::string to_prefix(void)  const { return root->to_prefix();  }
 		/** Return the prefix (polish notation) stringification of the formula. */
+		std::string to_prefix(void)  const { return root->to_prefix();  }
+		/** Return the postfix (reverse polish notation) stringification of the formula. */
 		std::string to_postfix(void) const { return root->to_postfix(); }
 
+		/** Append or write the stringifications in linear time, see Ast::write_infix. */
+		void write_infix(std::string& out)   const { root->write_infix(out);   }
+		void write_infix(std::ostream& os)   const { root->write_infix(os);    }
+		void write_prefix(std::string& out)  const { root->write_prefix(out);  }
+		void write_prefix(std::ostream& os)  const { root->write_prefix(os);   }
+		void write_postfix(std::string& out) const { root->write_postfix(out); }
+		void write_postfix(std::ostream& os) const { root->write_postfix(os);  }
+
 		/** Construct a new formula negating this one. */
 		Formula notf(void) const;
 		/** Construct a new formula as the conjunction of this one and rhs. */
@@ -159,13 +209,28 @@ namespace Propcalc {
 		Formula operator|(const Formula& rhs) const { return orf(rhs);  }
 		Formula operator^(const Formula& rhs) const { return xorf(rhs); }
 
-		bool operator==(const Formula& rhs) {
+		bool operator==(const Formula& rhs) const {
 			return domain == rhs.domain && root->equals(*rhs.root);
 		}
 	};
 }
 
+namespace std {
+	/** Hash a Formula by the structural hash of its root node. */
+	template<>
+	struct hash<Propcalc::Formula> {
+		size_t operator()(const Propcalc::Formula& fm) const {
+			return fm.root->hash;
+		}
+	};
+}
+
 /* Complete the interface of Formula. */
+#include <propcalc/compiled.hpp>
+#include <propcalc/bittable.hpp>
+#ifndef PROPCALC_SINGLE_THREADED
+#include <propcalc/parallel.hpp>
+#endif
 #include <propcalc/truthtable.hpp>
 #include <propcalc/tseitin.hpp>
 #include <propcalc/cnf.hpp>
@@ -0,0 +1,75 @@
+/*
+ * hybrid.hpp - Hybrid of the CNF and Tseitin encodings
+ *
+ * Copyright (C) 2020 Tobias Boege
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the Artistic License 2.0
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ */
+
+#ifndef PROPCALC_HYBRID_HPP
+#define PROPCALC_HYBRID_HPP
+
+#include <memory>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <propcalc/ast.hpp>
+#include <propcalc/formula.hpp>
+#include <propcalc/cnf.hpp>
+#include <propcalc/tseitin.hpp>
+
+namespace Propcalc {
+	/**
+	 * This stream encodes each conjunct of a Formula (see CNF::conjuncts)
+	 * either by an equivalent CNF or by its Tseitin transform, whichever
+	 * is appropriate. A conjunct whose CNF is estimated to have at most
+	 * `budget` clauses is converted directly, in minimizing mode. The
+	 * others get auxiliary variables for their nodes, like in Tseitin.
+	 *
+	 * The clauses of all conjuncts live in one domain, which is a
+	 * Tseitin domain: the variables of the formula are represented by
+	 * the Tseitin variables of their Ast::Var nodes, so that `lift` and
+	 * `project` work as for Tseitin. The clauses of direct conjuncts
+	 * come first.
+	 */
+	class Hybrid : public Tseitin {
+		/* Clauses of the directly converted conjuncts, in the source domain. */
+		std::optional<CNF> direct;
+		/* Source variable to its Tseitin variable. */
+		std::unordered_map<VarRef, VarRef> rename;
+
+	public:
+		/**
+		 * Encode the formula with the given clause budget per conjunct.
+		 * A budget of zero means to use Tseitin for every conjunct which
+		 * is not constant true. The same comments as for the CNF
+		 * constructor apply to `caching`.
+		 */
+		Hybrid(const Formula& fm, uint64_t budget = 64, bool caching = false);
+
+		/**
+		 * Estimate the number of clauses of the minimized CNF of `ast`.
+		 * This is derived from the number of variables and an upper
+		 * bound on the size of the CNF obtained by distributing Or over
+		 * And. For a clause, it is one. If the subtree has more than
+		 * Minimize::MAX_VARS variables and is not a clause, it is the
+		 * number of rows of its truthtable, saturated at UINT64_MAX.
+		 */
+		static uint64_t estimate(const Ast::Ref& ast);
+
+		/** Like `estimate`, and add the variables of `ast` to `vars`. */
+		static uint64_t estimate(const Ast::Ref& ast, std::unordered_set<VarRef>& vars);
+
+		Hybrid& operator++(void);
+	};
+}
+
+#endif /* PROPCALC_HYBRID_HPP */
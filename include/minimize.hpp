@@ -0,0 +1,48 @@
+/*
+ * minimize.hpp - Two-level minimization of CNFs
+ *
+ * Copyright (C) 2020 Tobias Boege
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the Artistic License 2.0
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ */
+
+#ifndef PROPCALC_MINIMIZE_HPP
+#define PROPCALC_MINIMIZE_HPP
+
+#include <vector>
+
+#include <propcalc/bittable.hpp>
+#include <propcalc/conjunctive.hpp>
+
+namespace Propcalc::Minimize {
+	/** Up to this many variables, all prime implicates are computed. */
+	constexpr unsigned int EXACT_VARS = 10;
+	/** Up to this many variables, the heuristic is used. */
+	constexpr unsigned int MAX_VARS = 20;
+
+	/**
+	 * Return a set of prime implicates whose conjunction is equivalent
+	 * to the function given by the truth table. The variables in each
+	 * clause are in the order of `Bittable::vars()`.
+	 *
+	 * With at most EXACT_VARS variables, all prime implicates are found
+	 * by the method of Quine and McCluskey. The cover takes the essential
+	 * ones and then greedily those which cover most falsifying rows.
+	 * Larger tables are minimized heuristically, in the manner of
+	 * Espresso: each falsifying row not yet covered is expanded into a
+	 * prime implicate by dropping literals, and redundant clauses are
+	 * removed at the end.
+	 *
+	 * The number of rows to check grows with 2^n, so this is meant for
+	 * tables on at most MAX_VARS variables, but that is not enforced.
+	 */
+	std::vector<Clause> cnf(const Bittable& bt);
+}
+
+#endif /* PROPCALC_MINIMIZE_HPP */
@@ -0,0 +1,154 @@
+/*
+ * parallel.hpp - ParallelTruthtable, ParallelCNF, multithreaded drivers
+ *
+ * Copyright (C) 2020 Tobias Boege
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the Artistic License 2.0
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ */
+
+#ifndef PROPCALC_PARALLEL_HPP
+#define PROPCALC_PARALLEL_HPP
+
+#include <propcalc/config.hpp>
+
+#ifdef PROPCALC_SINGLE_THREADED
+#error "ParallelTruthtable and ParallelCNF are not available in the single-threaded build"
+#endif
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <thread>
+#include <functional>
+
+#include <propcalc/ast.hpp>
+#include <propcalc/domain.hpp>
+#include <propcalc/compiled.hpp>
+#include <propcalc/conjunctive.hpp>
+
+namespace Propcalc {
+	class Formula;
+
+	/**
+	 * ParallelTruthtable runs through the truth table of a Formula on
+	 * several threads. Rows are numbered like in Bittable: slot i of the
+	 * variables in `Formula::vars()` order has the value of bit i of the
+	 * row number.
+	 *
+	 * The rows are split into 2^k shards of consecutive rows by fixing
+	 * the top k variables. Each thread starts with an equal range of
+	 * shards and steals shards from the others when it runs out. Inside
+	 * a shard, the formula is evaluated bit-sliced, see CompiledFormula.
+	 *
+	 * Unlike a Stream, the driver is not consumed by running it. All
+	 * methods may be called any number of times. If a sink throws, the
+	 * remaining shards are abandoned and the first exception is rethrown
+	 * in the calling thread.
+	 */
+	class ParallelTruthtable {
+		std::shared_ptr<const CompiledFormula> compiled;
+		unsigned int nthreads;
+		unsigned int prefix;
+
+		/** Work on a block of rows: shard, first row, packed values, words. */
+		using Work = std::function<void(uint64_t, uint64_t, const uint64_t*, unsigned int)>;
+
+		/**
+		 * Evaluate every shard on the thread pool, block by block, and
+		 * pass the values of the rows, packed as in Bittable::words, to
+		 * `work`. In shards smaller than 64 rows, the bits past the end
+		 * of the shard are zero. While the workers run, `consume` is
+		 * called in the calling thread with a function which waits until
+		 * all blocks of a shard are done. That function returns false if
+		 * the run was aborted.
+		 */
+		void run(const Work& work,
+			const std::function<void(const std::function<bool(uint64_t)>&)>& consume = nullptr) const;
+
+	public:
+		/**
+		 * Prepare the truth table of the formula on `threads` threads.
+		 * Zero means one thread per hardware thread. The number of
+		 * fixed variables is chosen automatically unless `prefix` is
+		 * given, in which case it is clamped to the number of variables.
+		 * An std::length_error is thrown if the formula has 64 or more
+		 * variables.
+		 */
+		ParallelTruthtable(const Formula& fm, unsigned int threads = 0, int prefix = -1);
+
+		/** The variables in slot order. This is the same as `Formula::vars()`. */
+		const std::vector<VarRef>& vars(void) const { return compiled->vars(); }
+
+		/** The number of rows, 2^n. */
+		uint64_t size(void) const { return uint64_t(1) << vars().size(); }
+
+		/** The number of threads used. */
+		unsigned int threads(void) const { return nthreads; }
+
+		/** The number of shards, 2^k. */
+		uint64_t shards(void) const { return uint64_t(1) << prefix; }
+
+		/** The number of satisfying rows. */
+		uint64_t count(void) const;
+
+		/** The satisfying rows in ascending order. */
+		std::vector<uint64_t> satisfying(void) const;
+
+		/**
+		 * Call `sink` on every satisfying row. If `ordered` is true,
+		 * the rows of each shard are buffered and `sink` is called in
+		 * the calling thread, in ascending order. Otherwise `sink` is
+		 * called concurrently from the worker threads in no particular
+		 * order, so it must be thread-safe.
+		 */
+		void for_each(const std::function<void(uint64_t)>& sink, bool ordered = false) const;
+	};
+
+	/**
+	 * This stream produces the same clauses as CNF, but it converts the
+	 * conjuncts of the formula (see CNF::conjuncts) on a pool of threads.
+	 * The clauses of each conjunct are buffered until the stream gets to
+	 * them.
+	 *
+	 * In ordered mode, the clauses come in the same order as from CNF.
+	 * Otherwise, the conjuncts come in the order in which they are done,
+	 * so that a slow conjunct does not hold up the others. Clauses are
+	 * not deduplicated across conjuncts.
+	 *
+	 * The stream owns its threads. It cannot be copied, and destroying
+	 * it stops the threads after their current conjunct. An exception
+	 * thrown while converting a conjunct is rethrown by `operator++`.
+	 */
+	class ParallelCNF : public Conjunctive {
+		struct Shared;
+		std::shared_ptr<Shared> shared;
+		std::vector<std::thread> pool;
+
+		std::vector<Clause> batch;
+		size_t pos = 0;
+		bool valid = true;
+
+	public:
+		/**
+		 * Convert on `threads` threads, zero meaning one per hardware
+		 * thread. The `caching` and `minimize` flags are as for CNF.
+		 */
+		ParallelCNF(const Formula& fm, unsigned int threads = 0, bool ordered = true,
+			bool caching = false, bool minimize = false);
+		ParallelCNF(const ParallelCNF&) = delete;
+		ParallelCNF& operator=(const ParallelCNF&) = delete;
+		~ParallelCNF(void);
+
+		operator bool(void) const { return valid; }
+
+		ParallelCNF& operator++(void);
+	};
+}
+
+#endif /* PROPCALC_PARALLEL_HPP */
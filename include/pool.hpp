@@ -0,0 +1,93 @@
+/*
+ * pool.hpp - Pool, allocator of small blocks for AST nodes
+ *
+ * Copyright (C) 2020 Tobias Boege
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the Artistic License 2.0
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ */
+
+#ifndef PROPCALC_POOL_HPP
+#define PROPCALC_POOL_HPP
+
+#include <cstddef>
+#include <new>
+
+#include <propcalc/config.hpp>
+
+namespace Propcalc {
+	/**
+	 * Pool hands out small blocks of memory from large slabs. Blocks
+	 * come in size classes of GRAIN bytes up to MAX_BLOCK bytes, and a
+	 * freed block is kept on the free list of its class for the next
+	 * allocation of that size. Larger requests go to `operator new`.
+	 * Slabs are never returned to the system.
+	 *
+	 * Each thread keeps its own free lists, so that allocating and
+	 * freeing does not synchronize in the common case. Blocks may be
+	 * freed on another thread than the one which allocated them. When a
+	 * thread has too many free blocks of a class, or when it exits, it
+	 * passes them on to a global free list, from which the other threads
+	 * refill theirs.
+	 *
+	 * If the library is built with PROPCALC_SINGLE_THREADED, there is
+	 * only the global free list and it is not locked. All nodes must
+	 * then be created and destroyed on one thread at a time.
+	 */
+	class Pool {
+	public:
+		/** Block sizes are multiples of this, which is also their alignment. */
+		static constexpr size_t GRAIN = 8;
+		/** The largest block size. */
+		static constexpr size_t MAX_BLOCK = 256;
+		/** Size of a slab. */
+		static constexpr size_t SLAB = 64 * 1024;
+		/** Number of blocks moved between a thread and the global list at once. */
+		static constexpr size_t BATCH = 128;
+
+		static void* allocate(size_t bytes);
+		static void deallocate(void* p, size_t bytes) noexcept;
+
+		/** Bytes in slabs taken from the system so far. */
+		static size_t reserved(void);
+
+		/**
+		 * Allocator for the standard containers and `std::allocate_shared`
+		 * which takes single objects from the pool.
+		 */
+		template<typename T>
+		class Allocator {
+		public:
+			using value_type = T;
+
+			Allocator(void) = default;
+			template<typename U>
+			Allocator(const Allocator<U>&) { }
+
+			T* allocate(size_t n) {
+				if (n == 1 && alignof(T) <= GRAIN)
+					return static_cast<T*>(Pool::allocate(sizeof(T)));
+				return static_cast<T*>(::operator new(n * sizeof(T)));
+			}
+
+			void deallocate(T* p, size_t n) noexcept {
+				if (n == 1 && alignof(T) <= GRAIN)
+					Pool::deallocate(p, sizeof(T));
+				else
+					::operator delete(p);
+			}
+
+			template<typename U>
+			bool operator==(const Allocator<U>&) const { return true; }
+			template<typename U>
+			bool operator!=(const Allocator<U>&) const { return false; }
+		};
+	};
+}
+
+#endif /* PROPCALC_POOL_HPP */
@@ -21,6 +21,7 @@
 #include <propcalc/assignment.hpp>
 #include <propcalc/conjunctive.hpp>
 #include <propcalc/formula.hpp>
+#include <propcalc/hybrid.hpp>
 #include <propcalc/dimacs.hpp>
 
 #endif /* PROPCALC_HPP */
@@ -17,6 +17,7 @@
 
 #include <stdexcept>
 #include <vector>
+#include <utility>
 
 namespace Propcalc {
 	namespace X::Stream {
@@ -48,7 +49,7 @@ namespace Propcalc {
 	 */
 	template<typename T>
 	class Stream {
-		bool caching;
+		bool caching = false;
 		std::vector<T> cache;
 
 	protected:
@@ -58,12 +59,21 @@ namespace Propcalc {
 		void produce(T v) {
 			if (caching)
 				cache.push_back(v);
-			value = v;
+			value = std::move(v);
+		}
+
+		/**
+		 * Produce the new value which was written to `value` in place,
+		 * to reuse its storage. This is needed to get caching to work.
+		 */
+		void produced(void) {
+			if (caching)
+				cache.push_back(value);
 		}
 
 	public:
 		/** Return the current element. */
-		virtual T operator*(void) const { return value; };
+		virtual const T& operator*(void) const { return value; };
 		/** Produce the next element. */
 		virtual Stream<T>& operator++(void) = 0;
 		/** Return if the stream points at a valid value. */
@@ -105,8 +115,8 @@ namespace Propcalc {
 		using iterator_category = std::forward_iterator_tag;
 		using value_type = T;
 		using difference_type = std::ptrdiff_t;
-		using pointer = T*;
-		using reference = T&;
+		using pointer = const T*;
+		using reference = const T&;
 
 		iterator(Stream<T>* st) : st(st) { }
 		iterator(void)     : st(nullptr) { }
@@ -127,7 +137,7 @@ namespace Propcalc {
 			return not (*this != b);
 		}
 
-		T operator*(void) const {
+		const T& operator*(void) const {
 			if (idx < st->size())
 				return st->cache[idx];
 			return **st;
@@ -15,22 +15,129 @@
 #ifndef PROPCALC_TRUTHTABLE_HPP
 #define PROPCALC_TRUTHTABLE_HPP
 
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include <algorithm>
+#include <optional>
+#include <cstdint>
+
 #include <propcalc/stream.hpp>
 #include <propcalc/formula.hpp>
 #include <propcalc/assignment.hpp>
+#include <propcalc/compiled.hpp>
 
 namespace Propcalc {
 	/**
 	 * This stream takes a Formula and lazily runs through all of its
 	 * assignments in lexicographic order, producing an std::pair of
 	 * the assignment and the bool the Formula yields on it.
+	 *
+	 * In sliced mode, the formula is compiled and the values of the
+	 * next 64 to 512 rows are computed in one bit-sliced pass by
+	 * CompiledFormula::eval_rows, instead of evaluating each row.
+	 *
+	 * In Gray mode, the assignments are enumerated in the order of the
+	 * reflected binary Gray code instead, so that exactly one variable
+	 * changes between consecutive rows. The formula is re-evaluated
+	 * only on the fan-out cone of that variable, see
+	 * CompiledFormula::Incremental.
 	 */
 	class Truthtable : public Stream<std::pair<Assignment, bool>> {
+	public:
+		/**
+		 * A half-open range `[begin, end)` of row numbers. Rows are
+		 * numbered in the enumeration order of the stream, starting at
+		 * zero. In lexicographic order, the number of a row is the rank
+		 * of its assignment, see Assignment::rank.
+		 */
+		struct Range {
+			uint64_t begin, end;
+		};
+
+	private:
 		Formula fm;
 		Assignment last;
 
+		std::shared_ptr<const CompiledFormula> compiled;
+		std::vector<uint64_t> block;
+		uint64_t block_first = UINT64_MAX;
+
+		std::optional<CompiledFormula::Incremental> incr;
+
+		uint64_t row = 0;
+		uint64_t stop = UINT64_MAX;
+
+		bool next_value(void) {
+			if (incr)
+				return incr->value();
+			if (!compiled)
+				return fm.eval(last);
+			/* Refill the block when entering a new one. */
+			uint64_t width = 64 * block.size();
+			uint64_t i = row % width;
+			if (row - i != block_first) {
+				block_first = row - i;
+				compiled->eval_rows(block_first, block.data(), block.size());
+			}
+			return (block[i / 64] >> (i % 64)) & 1;
+		}
+
+		/** Move to the given row in O(n) operations. */
+		void seek(uint64_t r) {
+			row = r;
+			if (!incr) {
+				last = Assignment(last.vars(), r);
+				return;
+			}
+			/* Row r of the Gray code is the assignment of rank r ^ (r >> 1). */
+			uint64_t g = r ^ (r >> 1);
+			for (; g; g &= g - 1) {
+				unsigned int i = __builtin_ctzll(g);
+				last.flip(i);
+				incr->flip(i);
+			}
+		}
+
 	public:
-		Truthtable(const Formula& fm) : fm(fm), last(fm.assignment()) { }
+		Truthtable(const Formula& fm, bool sliced = false, bool gray = false) :
+			fm(fm), last(fm.assignment())
+		{
+			if (gray) {
+				compiled = std::make_shared<CompiledFormula>(fm);
+				incr.emplace(compiled);
+			}
+			else if (sliced) {
+				compiled = std::make_shared<CompiledFormula>(fm);
+				/* Only fill the native vector width if there are enough rows. */
+				auto n = fm.vars().size();
+				block.resize(n >= 9 ? CompiledFormula::native_words() : 1);
+			}
+			if (last.vars().size() < 64)
+				stop = uint64_t(1) << last.vars().size();
+		}
+
+		/**
+		 * Enumerate only the rows in the given range. The range is
+		 * clipped to the size of the truthtable. An std::length_error
+		 * is thrown if the formula has more than 64 variables.
+		 */
+		Truthtable(const Formula& fm, Range range, bool sliced = false, bool gray = false) :
+			Truthtable(fm, sliced, gray)
+		{
+			if (last.vars().size() > 64)
+				throw std::length_error("Truthtable ranges need at most 64 variables");
+			stop = std::min(stop, range.end);
+			if (range.begin >= stop)
+				last.overflown() = true;
+			else
+				seek(range.begin);
+		}
+
+		/** Whether the stream is in sliced mode. */
+		bool is_sliced(void) const { return compiled && !incr; }
+		/** Whether the stream is in Gray mode. */
+		bool is_gray(void) const { return !!incr; }
 
 		bool eval(void) const { return value.second; }
 		const Assignment& assigned(void) const { return value.first; }
@@ -40,8 +147,21 @@ namespace Propcalc {
 		}
 
 		Truthtable& operator++(void) {
-			produce(std::make_pair(last, fm.eval(last)));
-			++last;
+			produce(std::make_pair(last, next_value()));
+			if (++row >= stop) {
+				last.overflown() = true;
+				return *this;
+			}
+
+			if (!incr) {
+				++last;
+				return *this;
+			}
+
+			/* Row r differs from row r-1 in the lowest set bit of r. */
+			unsigned int i = __builtin_ctzll(row);
+			last.flip(i);
+			incr->flip(i);
 			return *this;
 		}
 	};
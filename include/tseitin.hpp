@@ -16,12 +16,17 @@
 #define PROPCALC_TSEITIN_HPP
 
 #include <queue>
+#include <vector>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
+#include <unordered_set>
 
 #include <propcalc/ast.hpp>
 #include <propcalc/domain.hpp>
+#include <propcalc/assignment.hpp>
 #include <propcalc/conjunctive.hpp>
+#include <propcalc/clausebuf.hpp>
 #include <propcalc/formula.hpp>
 
 namespace Propcalc {
@@ -38,76 +43,220 @@ namespace Propcalc {
 	 * can be obtained from Tseitin::get_domain() and which allows to
 	 * look up Tseitin::Variable objects by their AST node in the
 	 * original formula. Conversel, the variable objects also store
-	 * an std::shared_ptr to the AST node.
+	 * an Ast::Ref to the AST node.
+	 *
+	 * Subtrees which occur more than once, either as the same object or
+	 * as equal structures, share their variable and are defined by one
+	 * set of clauses. The size of the transform is thus linear in the
+	 * size of the formula as a DAG.
+	 *
+	 * An n-ary conjunction or disjunction gets a single variable and is
+	 * defined by one clause per operand and one long clause. It pays to
+	 * use Formula::flatten before the transform, as a chain of n binary
+	 * nodes would get n - 1 variables instead.
+	 *
+	 * In polarity mode, which is the encoding of Plaisted and Greenbaum,
+	 * each node only gets the clauses for the directions of its defining
+	 * equivalence which are needed under the polarities it occurs in.
+	 * For a node which only occurs positively, `c -> a & b` suffices
+	 * instead of `c = a & b`. The result is still equisatisfiable and
+	 * `lift` still turns a satisfying assignment into a satisfying one
+	 * of the transform. However, the Tseitin variables of a satisfying
+	 * assignment of the transform need not match the values of their
+	 * nodes, only the projection is meaningful.
 	 */
 	class Tseitin : public Conjunctive {
+	protected:
+		/**
+		 * The variable of a node is named "Tseitin[...]" after the infix
+		 * form of its subtree. The name is computed when it is first
+		 * needed, because writing out every subtree takes quadratic time.
+		 */
 		class Variable : public Propcalc::Variable {
+			mutable std::once_flag named;
+
 		public:
-			std::shared_ptr<Ast> ast;
-
-			Variable(std::shared_ptr<Ast> ast) :
-				/* XXX: This may be too costly for people who use the
-				 * Tseitin transform because it is fast. */
-				Propcalc::Variable("Tseitin[" + ast->to_infix() + "]"),
-				ast(ast)
-			{ }
+			Ast::Ref ast;
+
+			Variable(Ast::Ref ast) : Propcalc::Variable(""), ast(std::move(ast)) { }
+
+			const std::string& get_name(void) const {
+				std::call_once(named, [this] { name = "Tseitin[" + ast->to_infix() + "]"; });
+				return name;
+			}
 		};
 
 		class Domain : public Cache {
 		private:
-			std::unordered_map<std::shared_ptr<Ast>, VarRef> astcache;
+			std::unordered_map<Ast::Ref, VarRef, Ast::Hash, Ast::Equal> astcache;
+			Propcalc::Domain* source;
 
 		public:
-			VarRef get(std::shared_ptr<Ast> ast);
+			Domain(Propcalc::Domain* source) : source(source) { }
+
+			VarRef get(const Ast::Ref& ast);
+
+			/**
+			 * Find a variable by its name. The subtree in the name is
+			 * parsed on its own and its variables are looked up in the
+			 * source domain, which is not changed, so no other names
+			 * are computed. An std::out_of_range is thrown if there is
+			 * no such variable, also if the name does not parse or
+			 * contains a variable which the source does not have.
+			 */
+			VarRef resolve(std::string name);
+
+			/** Like `resolve`, but return nullptr if there is no such variable. */
+			VarRef lookup(const std::string& name);
+		};
+
+		/**
+		 * An n-ary exclusive or of k operands is defined by 2^k clauses.
+		 * One with more than this many operands is split into two halves
+		 * which get their own variables.
+		 */
+		static constexpr size_t XOR_WIDTH = 4;
+
+		/* Polarities in which a node occurs, as a bit mask. */
+		enum Polarity : unsigned char {
+			Positive = 1,
+			Negative = 2,
+			Both     = 3,
 		};
 
 		Formula fm;
 		std::shared_ptr<Tseitin::Domain> vars;
-		std::queue<std::shared_ptr<Ast>> queue;
-		std::queue<std::unique_ptr<Clause>> clauses;
-		std::unique_ptr<Clause> last;
+		bool polarity = false;
+		/* Polarities seen so far of every node, see populate_variables,
+		 * and the index of its Node below. */
+		struct Seen {
+			unsigned char pol = 0;
+			size_t slot = 0;
+		};
+		std::unordered_map<VarRef, Seen> seen;
+		/* Directions of the definition of each node which were already
+		 * emitted, as Polarity bits, and the roots already asserted. */
+		std::unordered_map<VarRef, unsigned char> defined;
+		std::unordered_set<VarRef> asserted;
+		std::queue<Ast::Ref> queue;
+		ClauseBuffer clauses;
 		/* Whether the iterator is valid, i.e. last was populated with
 		 * a new Assignment when operator++ last ran. */
 		bool valid;
 
-		void populate_variables(std::shared_ptr<Ast> root);
+		/*
+		 * The nodes in the domain with their operands before them, for
+		 * `lift`. `pos` is the position of the variable in the domain,
+		 * `lhs` and `rhs` are indices into `nodes`. For n-ary nodes, the
+		 * indices of the operands are `args[lhs]` up to `args[lhs + rhs - 1]`.
+		 */
+		struct Node {
+			const Ast* ast;
+			size_t pos;
+			size_t lhs, rhs;
+		};
+		std::vector<Node> nodes;
+		std::vector<size_t> args;
+		/* Scratch space for the long clauses of n-ary nodes. */
+		Clause scratch;
+		/* The variables in domain order. */
+		std::vector<VarRef> order;
+		/* Positions of the variables of Ast::Var nodes in the domain, and
+		 * the corresponding source variables, for `project`. */
+		std::vector<size_t> leaves;
+		std::vector<VarRef> sources;
+		/* The all-false assignments on `order` and `sources`, which are
+		 * copied to share their position index. */
+		Assignment lifted, projected;
+		std::vector<char> values;
+
+		/**
+		 * Put the variables of the subtree into the domain, record the
+		 * polarities in which they occur and return the index of the
+		 * Node of `root`. The traversal is iterative.
+		 */
+		size_t populate_variables(const Ast::Ref& root, unsigned char pol);
+
+		/**
+		 * Put the variable of the exclusive or of `ops`, which is half
+		 * of a wider one, into the domain, splitting it further if need
+		 * be. The Nodes of the operands are at `slots`.
+		 */
+		size_t populate_parity(const std::vector<Ast::Ref>& ops, const size_t* slots);
+
+		/** The operands by which an n-ary node is defined, see XOR_WIDTH. */
+		static std::vector<Ast::Ref> operands(const Ast::Nary* node);
+
+		/** Tag for the constructor which leaves the stream empty. */
+		struct Deferred { };
+		/**
+		 * Set up the domain without encoding anything. The first
+		 * clause must be made available by the derived class.
+		 */
+		Tseitin(const Formula& fm, Deferred);
+
+		/**
+		 * Add the clauses which assert the subtree `root` to the
+		 * stream. Its variables are put into the domain right away.
+		 * Subtrees which were encoded before are not defined again,
+		 * except for directions needed under a new polarity.
+		 */
+		void encode(const Ast::Ref& root);
 
 	public:
 		Propcalc::Domain* domain; /* = vars.get() */
 
-		Tseitin(const Formula& fm);
+		/**
+		 * The same comments as for the CNF constructor apply to `caching`.
+		 * If `polarity` is true, the Plaisted-Greenbaum encoding is used.
+		 */
+		Tseitin(const Formula& fm, bool caching = false, bool polarity = false);
 
-		/** Lift an assignment from the source domain to the Tseitin domain. */
-		Assignment lift(const Assignment& assign) {
-			Assignment lassign;
-
-			for (auto& v : vars->list()) {
-				auto tv = static_cast<const Tseitin::Variable*>(v);
-				lassign[v] = tv->ast->eval(assign);
-			}
-			return lassign;
-		}
+		/**
+		 * Lift an assignment from the source domain to the Tseitin domain.
+		 * The assignment must be defined on all variables of the formula,
+		 * otherwise an std::out_of_range exception is thrown. This takes
+		 * one pass over the nodes, evaluating each of them from the
+		 * values of its operands.
+		 */
+		Assignment lift(const Assignment& assign);
 
 		/** Project an assignment from the Tseitin domain to the source domain. */
-		Assignment project(const Assignment& lassign) {
-			Assignment assign;
-
-			for (auto& v : vars->list()) {
-				auto tv = static_cast<const Tseitin::Variable*>(v);
-				if (tv->ast->type() != Ast::Type::Var)
-					continue;
-				auto w = static_cast<const Ast::Var*>(tv->ast.get())->var;
-				assign[w] = lassign[v];
-			}
-
-			return assign;
-		}
+		Assignment project(const Assignment& lassign);
 
 		operator bool(void) const {
 			return valid;
 		}
 
 		Tseitin& operator++(void);
+
+		class Incremental;
+	};
+
+	/**
+	 * A Tseitin transform to which formulas over one source domain are
+	 * added one at a time. All of them share one Tseitin domain, so a
+	 * subtree which was encoded before keeps its variable and is not
+	 * defined again. The stream yields the clauses of each formula when
+	 * it is added, without those already emitted. When the stream runs
+	 * out, it becomes valid again with the next formula which needs new
+	 * clauses.
+	 *
+	 * The conjunction of all clauses is the Tseitin transform of the
+	 * conjunction of the added formulas. This is meant for incremental
+	 * SAT solving, where constraints arrive over time.
+	 */
+	class Tseitin::Incremental : public Tseitin {
+	public:
+		/** Start with no formulas on the given source domain. */
+		Incremental(Propcalc::Domain* source = &Formula::DefaultDomain,
+			bool caching = false, bool polarity = false);
+
+		/**
+		 * Assert the formula. An std::invalid_argument is thrown if it
+		 * is not on the source domain.
+		 */
+		Incremental& add(const Formula& fm);
 	};
 }
 
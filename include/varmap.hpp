@@ -16,6 +16,9 @@
 #define PROPCALC_VARMAP_HPP
 
 #include <vector>
+#include <memory>
+#include <cstdint>
+#include <stdexcept>
 #include <unordered_map>
 
 #include <propcalc/domain.hpp>
@@ -25,34 +28,132 @@ namespace Propcalc {
 	 * VarMap represents a (partial) mapping from a collection of variables
 	 * to truth values. It is not tied to a Domain object but the variables
 	 * are totally ordered.
+	 *
+	 * The values are stored densely: the variable at position i in the
+	 * order has its value in bit i of a packed bit vector. Positions of
+	 * few variables are found by a linear scan of the order. Only larger
+	 * maps keep an index from variables to positions, which is shared
+	 * between copies.
 	 */
 	class VarMap {
+	public:
+		/** Returned by `position` for variables not in the map. */
+		static constexpr size_t npos = size_t(-1);
+
+		/** Maps with more variables than this keep a position index. */
+		static constexpr size_t INDEX_THRESHOLD = 16;
+
+		/**
+		 * Proxy for the value of one variable, returned by the
+		 * value-assignment form of `operator[]`.
+		 */
+		class reference {
+			uint64_t* word;
+			uint64_t mask;
+
+		public:
+			reference(uint64_t* word, uint64_t mask) : word(word), mask(mask) { }
+
+			operator bool(void) const { return *word & mask; }
+
+			reference& operator=(bool b) {
+				if (b)
+					*word |= mask;
+				else
+					*word &= ~mask;
+				return *this;
+			}
+
+			reference& operator=(const reference& r) {
+				return *this = bool(r);
+			}
+
+			reference& operator^=(bool b) {
+				if (b)
+					*word ^= mask;
+				return *this;
+			}
+		};
+
 	protected:
 		std::vector<VarRef> order;
-		std::unordered_map<VarRef, bool> vmap;
+		std::vector<uint64_t> bits;
+		/* Copies share the index until one of them adds a variable. */
+		std::shared_ptr<std::unordered_map<VarRef, size_t>> index;
+
+		/** Append a variable with the given value. It must not exist yet. */
+		size_t push(VarRef v, bool b) {
+			size_t i = order.size();
+			order.push_back(v);
+			if (i % 64 == 0)
+				bits.push_back(0);
+			if (b)
+				bits[i / 64] |= uint64_t(1) << (i % 64);
+			if (index) {
+				if (index.use_count() > 1)
+					index = std::make_shared<std::unordered_map<VarRef, size_t>>(*index);
+				index->insert({ v, i });
+			}
+			else if (order.size() > INDEX_THRESHOLD) {
+				index = std::make_shared<std::unordered_map<VarRef, size_t>>();
+				for (size_t j = 0; j < order.size(); ++j)
+					index->insert({ order[j], j });
+			}
+			return i;
+		}
+
+		/** Clear the unused bits of the last word. */
+		void mask_tail(void) {
+			if (order.size() % 64)
+				bits.back() &= (uint64_t(1) << (order.size() % 64)) - 1;
+		}
 
 	public:
 		/** Create a dummy assignment on no variables. */
 		VarMap(void) { }
 
 		/** Create the all-false assignment on the given variables. */
-		VarMap(std::vector<VarRef> vars) : order(vars) {
-			for (auto& v : order)
-				vmap.insert({ v, false });
+		VarMap(std::vector<VarRef> vars) {
+			order.reserve(vars.size());
+			bits.reserve((vars.size() + 63) / 64);
+			for (auto& v : vars) {
+				if (!exists(v))
+					push(v, false);
+			}
 		}
 
 		/** Initialize the mapping with the given data. */
 		VarMap(std::initializer_list<std::pair<VarRef, bool>> il) {
 			/* Order specified by the list */
 			for (auto& p : il) {
-				order.push_back(p.first);
-				vmap.insert(p);
+				if (!exists(p.first))
+					push(p.first, p.second);
 			}
 		}
 
+		/** Remove all variables. The storage is kept for reuse. */
+		void clear(void) {
+			order.clear();
+			bits.clear();
+			index.reset();
+		}
+
 		/** Whether a variable is referenced in the assignment at all. */
 		bool exists(VarRef var) const {
-			return vmap.count(var) > 0;
+			return position(var) != npos;
+		}
+
+		/** The position of a variable in the order, or `npos`. */
+		size_t position(VarRef var) const {
+			if (index) {
+				auto it = index->find(var);
+				return it == index->end() ? npos : it->second;
+			}
+			for (size_t i = 0; i < order.size(); ++i) {
+				if (order[i] == var)
+					return i;
+			}
+			return npos;
 		}
 
 		/** A const reference to the internal order of variables. */
@@ -60,24 +161,51 @@ namespace Propcalc {
 			return order;
 		}
 
+		/** The number of variables. */
+		size_t size(void) const {
+			return order.size();
+		}
+
+		/** The value of the variable at position i. */
+		bool value(size_t i) const {
+			return (bits[i / 64] >> (i % 64)) & 1;
+		}
+
+		/** Flip the value of the variable at position i. */
+		void flip(size_t i) {
+			bits[i / 64] ^= uint64_t(1) << (i % 64);
+		}
+
+		/**
+		 * The packed values. The value at position i is in bit `i % 64`
+		 * of word `i / 64`. Bits past the last position are zero.
+		 */
+		const std::vector<uint64_t>& words(void) const {
+			return bits;
+		}
+
 		/**
 		 * Return the bool associated with the given variable.
 		 * In the value-assignment form, a non-existent variable
 		 * is added (as the last variable). In the value-read form,
 		 * an std::out_of_range exception is thrown.
 		 */
-		bool& operator[](VarRef v) {
-			if (not vmap.count(v))
-				order.push_back(v);
-			return vmap[v];
+		reference operator[](VarRef v) {
+			size_t i = position(v);
+			if (i == npos)
+				i = push(v, false);
+			return reference(&bits[i / 64], uint64_t(1) << (i % 64));
 		}
 
 		bool operator[](VarRef v) const {
-			return vmap.at(v);
+			size_t i = position(v);
+			if (i == npos)
+				throw std::out_of_range("Variable not in VarMap");
+			return value(i);
 		}
 
 		bool operator==(const VarMap& b) const {
-			return order == b.order && vmap == b.vmap;
+			return order == b.order && bits == b.bits;
 		}
 	};
 }
@@ -0,0 +1,223 @@
+#include <tappp/tappp.hpp>
+#include <propcalc/propcalc.hpp>
+
+#include <cstdlib>
+#include <algorithm>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+
+using namespace TAP;
+using namespace Propcalc;
+
+int main(void) {
+	plan(7);
+
+	SUBTEST(8, "hash-consing") {
+		Formula f("(a & b) | (a & b)");
+		Formula g("a & b");
+		auto Or = static_cast<Ast::Or*>(f.root.get());
+
+		ok(Or->lhs == Or->rhs, "repeated subformula is shared");
+		ok(Or->lhs == g.root, "subformula is shared across formulas");
+		ok(f.root->interned, "parsed formula is interned");
+		ok((g & g).root == (g & g).root, "connectives are interned");
+		ok(Formula("b | a & b").simplify(Assignment({{ g.domain->resolve("b"), true }})).root
+			== Ast::constant(true), "simplify is interned");
+		ok(!g.root->equals(*Formula("b & a").root), "distinct interned nodes are not equal");
+
+		auto a = Ast::fresh<Ast::Var>(g.domain->resolve("a"));
+		auto b = Ast::fresh<Ast::Var>(g.domain->resolve("b"));
+		auto h = Ast::fresh<Ast::And>(a, b);
+		ok(!h->interned, "manually allocated node is not interned");
+		ok(h->equals(*g.root), "but structurally equal");
+	}
+
+	SUBTEST(5, "structural hash") {
+		Formula g("a & ~b");
+		auto a = Ast::fresh<Ast::Var>(g.domain->resolve("a"));
+		auto b = Ast::fresh<Ast::Var>(g.domain->resolve("b"));
+		auto h = Ast::fresh<Ast::And>(a, Ast::fresh<Ast::Not>(b));
+
+		is(h->hash, g.root->hash, "equal structures have equal hashes");
+		isnt(Formula("a & b").root->hash, Formula("b & a").root->hash, "operand order matters");
+		isnt(Formula("a & b").root->hash, Formula("a | b").root->hash, "node type matters");
+
+		std::unordered_set<Formula> set{ g, Formula(h), Formula("a | b") };
+		is(set.size(), 2, "std::hash<Formula> deduplicates");
+		ok(set.count(Formula("a | b")) == 1, "lookup by structure");
+	}
+
+	SUBTEST(9, "n-ary nodes") {
+		Formula f("a & b & (c & d)");
+		Formula flat = f.flatten();
+		auto And = static_cast<Ast::AndN*>(flat.root.get());
+		ok(flat.root->type() == Ast::Type::AndN && And->ops.size() == 4, "chain is flattened");
+		is(flat.to_postfix(), f.to_postfix(), "same postfix as the chain");
+		ok(flat.flatten().root == flat.root, "flattening is idempotent");
+
+		Formula g("a | b & c & d ^ e ^ (f ^ g) = ~(h | i | j)");
+		ok(g.flatten().truthtable_bits() == g.truthtable_bits(), "flattening preserves the truth table");
+
+		VarRef a = f.domain->resolve("a"), b = f.domain->resolve("b");
+		ok(flat.simplify(Assignment({{ b, true }})).root == Formula("a & c & d").flatten().root,
+			"simplify drops true operands");
+		ok(Formula("a ^ b ^ c").flatten().simplify(Assignment({{ a, true }})).root
+			== Formula("~(b ^ c)").flatten().root, "simplify keeps the parity");
+
+		/* Clauses are read into n-ary nodes. */
+		CNF cnf = Formula("(a | b | ~c) & (a | d) & (~b | c)").cnf(true);
+		Formula back(cnf, f.domain);
+		ok(back.root->type() == Ast::Type::AndN &&
+			static_cast<Ast::AndN*>(back.root.get())->ops[0]->type() == Ast::Type::OrN,
+			"CNF is read into n-ary nodes");
+
+		/* A deep chain becomes a single node. */
+		const unsigned int n = 10000;
+		auto chain = Ast::make<Ast::Var>(a);
+		for (unsigned int i = 0; i < n; ++i)
+			chain = Ast::make<Ast::Or>(Ast::make<Ast::Var>(i % 2 ? a : b), chain);
+		auto deep = Ast::flatten(chain);
+		ok(deep->type() == Ast::Type::OrN && static_cast<Ast::OrN*>(deep.get())->ops.size() == n + 1,
+			"deep chain is flattened");
+		ok(deep->eval(Assignment({{ a, false }, { b, true }})), "and evaluated");
+	}
+
+	SUBTEST(6, "simplify") {
+		Formula f("((a | b) & (c -> d)) & ~e");
+		VarRef a = f.domain->resolve("a"), e = f.domain->resolve("e");
+		auto lhs = static_cast<Ast::And*>(f.root.get())->lhs;
+		auto rhs = static_cast<Ast::And*>(f.root.get())->rhs;
+
+		ok(Ast::constant(true) == Ast::make<Ast::Const>(true), "constants are unique");
+		ok(f.simplify(Assignment({{ f.domain->resolve("x"), true }})).root == f.root,
+			"unchanged formula is returned as is");
+
+		Formula g = f.simplify(Assignment({{ e, false }}));
+		ok(g.root == lhs, "true operand is dropped");
+		Formula h = f.simplify(Assignment({{ a, false }}));
+		ok(static_cast<Ast::And*>(static_cast<Ast::And*>(h.root.get())->lhs.get())->rhs
+			== static_cast<Ast::And*>(lhs.get())->rhs, "unchanged subtree is shared");
+		ok(static_cast<Ast::And*>(h.root.get())->rhs == rhs, "unchanged sibling is shared");
+		ok(f.simplify(Assignment({{ a, true }, { e, true }})).root == Ast::constant(false),
+			"falsified formula is the false constant");
+	}
+
+	SUBTEST(5, "writers") {
+		Formula f("(a | \\T) & ~(b -> c) = d ^ (e ^ f & a)");
+		Formula flat = f.flatten();
+
+		std::ostringstream infix, prefix, postfix;
+		flat.write_infix(infix);
+		flat.write_prefix(prefix);
+		flat.write_postfix(postfix);
+		is(infix.str(), flat.to_infix(), "infix to a stream");
+		is(prefix.str(), flat.to_prefix(), "prefix to a stream");
+		is(postfix.str(), flat.to_postfix(), "postfix to a stream");
+		is(flat.to_postfix(), f.to_postfix(), "n-ary postfix like the chain");
+
+		std::string out = "fm: ";
+		f.write_infix(out);
+		is(out, "fm: " + f.to_infix(), "infix appended to a buffer");
+	}
+
+	SUBTEST(4, "pool") {
+		void* p = Pool::allocate(40);
+		Pool::deallocate(p, 40);
+		ok(Pool::allocate(33) == p, "freed block is reused");
+		Pool::deallocate(p, 33);
+
+		/* Nodes made on one thread and freed on another. */
+		const size_t reserved = Pool::reserved();
+		Formula shared("a | b & ~c");
+		for (int round = 0; round < 4; ++round) {
+			std::vector<Ast::Ref> nodes;
+			std::thread maker([&] {
+				for (unsigned int i = 0; i < 10000; ++i)
+					nodes.push_back(Ast::make<Ast::And>(shared.root, Ast::make<Ast::Var>(
+						Formula::DefaultDomain.resolve("p" + std::to_string(i)))));
+			});
+			maker.join();
+			std::thread([&] { nodes.clear(); }).join();
+		}
+		ok(Pool::reserved() - reserved < 4 * 10000 * 72, "blocks freed on other threads are reused");
+		ok(shared.root->eval(Assignment({{ shared.domain->resolve("a"), true }})), "shared nodes intact");
+
+		std::vector<Ast::Ref> kept;
+		std::thread([&] { kept.push_back(Ast::make<Ast::Not>(shared.root)); }).join();
+		ok(kept[0]->to_infix() == "~([a] | [b] & ~[c])", "nodes outlive the thread which made them");
+	}
+
+	SUBTEST(12, "deep formulas") {
+		Formula f("a & b");
+		VarRef a = f.domain->resolve("a"), b = f.domain->resolve("b");
+		Assignment assign({{ a, true }, { b, false }});
+
+		/* A chain made without the unique table, like one read from a
+		 * file, with its value on `assign` computed on the side. */
+		const size_t depth = 300000;
+		auto chain = [&] (VarRef first, bool& value) {
+			Ast::Ref node = Ast::fresh<Ast::Var>(first);
+			value = assign[first];
+			for (size_t i = 1; i < depth; ++i) {
+				VarRef v = i % 3 ? a : b;
+				auto x = Ast::fresh<Ast::Var>(v);
+				switch (i % 4) {
+				case 0: node = Ast::fresh<Ast::Not>(node);    value = !value;             break;
+				case 1: node = Ast::fresh<Ast::Xor>(x, node); value = value != assign[v]; break;
+				case 2: node = Ast::fresh<Ast::Or>(node, x);  value = value || assign[v]; break;
+				case 3: node = Ast::fresh<Ast::Impl>(node, x); value = !value || assign[v]; break;
+				}
+			}
+			return node;
+		};
+
+		bool value, other_value;
+		auto deep = chain(a, value);
+		auto twin = chain(a, value);
+		auto other = chain(b, other_value);
+
+		is(deep->eval(assign), value, "eval");
+		ok(deep->equals(*twin), "equals");
+		ok(!deep->equals(*other), "not equals at the bottom");
+		ok(Ast::simplify(deep, assign) == Ast::constant(value), "simplify to a constant");
+		ok(Ast::simplify(deep, Assignment()) == deep, "simplify without assignment shares the tree");
+
+		Ast::PostOrder<size_t> walk;
+		size_t size = walk.run(deep.get(), [] (const Ast*, const size_t* v, size_t n) {
+			size_t s = 1;
+			for (size_t i = 0; i < n; ++i)
+				s += v[i];
+			return s;
+		});
+		const std::string postfix = deep->to_postfix();
+		is(size_t(std::count(postfix.begin(), postfix.end(), ' ')) + 1, size, "to_postfix has every node");
+		ok(postfix.find("[a] [a] ^") != std::string::npos && postfix.substr(postfix.size() - 2) == " >",
+			"to_postfix has the bottom and the root");
+		const std::string prefix = deep->to_prefix(), infix = deep->to_infix();
+		is(size_t(std::count(prefix.begin(), prefix.end(), ' ')) + 1, size, "to_prefix has every node");
+		is(std::count(infix.begin(), infix.end(), '['), std::count(postfix.begin(), postfix.end(), '['),
+			"to_infix has every variable");
+
+		Formula fm(deep, f.domain);
+		size_t clauses = 0;
+		for (auto cl = fm.tseitin(); cl; ++cl)
+			clauses++;
+		ok(clauses > depth, "tseitin");
+
+		/* Operands are skipped by `enter` and `cut`. */
+		size_t visited = 0;
+		walk.run(Formula("(a | b) & (~a | b) & b").root.get(),
+			[&] (const Ast*, const size_t*, size_t) { return ++visited; },
+			[] (const Ast* node, const Ast*, size_t) { return node->type() != Ast::Type::Not; },
+			[] (const Ast* node, const size_t*, size_t i) { return node->type() == Ast::Type::Or && i == 1; });
+		is(visited, 7, "enter and cut");
+
+		deep.reset();
+		twin.reset();
+		other.reset();
+		ok(true, "destruction");
+	}
+
+	return EXIT_SUCCESS;
+}
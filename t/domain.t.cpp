@@ -2,12 +2,14 @@
 #include <propcalc/propcalc.hpp>
 
 #include <cstdlib>
+#include <thread>
+#include <vector>
 
 using namespace TAP;
 using namespace Propcalc;
 
 int main(void) {
-	plan(8);
+	plan(9);
 
 	Cache temp;
 	VarRef v3, v3_4, v_, vonce;
@@ -110,5 +112,44 @@ int main(void) {
 
 	is(temp.size(), 12, "size of cache is 12 now");
 
+	SUBTEST(5, "concurrent lookups") {
+		const size_t nthreads = 8, nvars = 5000;
+		std::vector<std::vector<VarRef>> seen(nthreads, std::vector<VarRef>(nvars));
+		std::vector<bool> consistent(nthreads, true);
+		std::vector<std::thread> threads;
+		for (size_t t = 0; t < nthreads; ++t) {
+			threads.emplace_back([&, t] {
+				/* The threads go through the names forwards and backwards
+				 * from different offsets, so that they race to create the
+				 * same variables. */
+				for (size_t k = 0; k < nvars; ++k) {
+					size_t i = ((t % 2 ? nvars - 1 - k : k) + t * nvars / nthreads) % nvars;
+					VarRef v = temp.resolve("v" + std::to_string(i));
+					seen[t][i] = v;
+					VarNr nr = temp.pack(v);
+					if (!nr || temp.unpack(nr) != v || v->name != "v" + std::to_string(i))
+						consistent[t] = false;
+				}
+			});
+		}
+		for (auto& th : threads)
+			th.join();
+
+		ok(std::all_of(consistent.begin(), consistent.end(), [] (bool b) { return b; }),
+			"pack and unpack agree while variables are created");
+		ok(std::all_of(seen.begin(), seen.end(), [&] (auto& s) { return s == seen[0]; }),
+			"all threads resolve to the same variables");
+		is(temp.size(), 12 + nvars, "every variable is created once");
+
+		auto list = temp.list();
+		bool numbered = true;
+		for (size_t i = 0; i < list.size(); ++i)
+			numbered &= temp.pack(list[i]) == i + 1;
+		ok(numbered, "list is in VarNr order");
+
+		Cache other;
+		is(other.pack(v3), 0, "variable of another cache packs to 0");
+	}
+
 	return EXIT_SUCCESS;
 }
@@ -4,6 +4,9 @@
 #include <propcalc/propcalc.hpp>
 
 #include <cstdlib>
+#include <sstream>
+#include <mutex>
+#include <algorithm>
 
 using namespace TAP;
 using namespace Propcalc;
@@ -87,15 +90,15 @@ static auto ttvals = std::vector<std::vector<bool>>{
 	{ false, false, true, true },  /* a ^ b ^ a */
 };
 
-static bool is_truthtable(const Formula& f, std::vector<bool>& ttval, std::string message = "") {
+static bool is_truthtable(const Formula& f, std::vector<bool>& ttval, bool sliced, std::string message = "") {
 	bool is_ok = true;
 	Assignment assign;
 	bool val = false;
 
 	if (message.empty())
-		message = f.to_postfix();
+		message = f.to_postfix() + (sliced ? " (sliced)" : "");
 
-	auto tt = f.truthtable();
+	auto tt = f.truthtable(false, sliced);
 	tt.cache_all();
 	if (tt.size() != 1UL << f.vars().size()) {
 		fail(message);
@@ -123,6 +126,51 @@ static bool is_truthtable(const Formula& f, std::vector<bool>& ttval, std::strin
 	return is_ok;
 }
 
+static bool is_gray_truthtable(const Formula& f, std::vector<bool>& ttval, std::string message = "") {
+	bool is_ok = true;
+	Assignment assign, prev;
+	bool val = false;
+	uint64_t idx = 0;
+
+	if (message.empty())
+		message = f.to_postfix() + " (gray)";
+
+	auto tt = f.truthtable_gray();
+	tt.cache_all();
+	if (tt.size() != 1UL << f.vars().size()) {
+		fail(message);
+		diag("truthtable has ", tt.size(), " rows instead of ", 1UL << f.vars().size());
+		return false;
+	}
+
+	unsigned int row = 0;
+	for (const auto& [assigned, value] : tt) {
+		/* Look up the row in lexicographic order. */
+		idx = 0;
+		for (size_t i = 0; i < assigned.size(); ++i)
+			idx |= uint64_t(assigned.value(i)) << i;
+		is_ok &= value == ttval[idx];
+		/* Consecutive rows differ in exactly one variable. */
+		if (row++ > 0) {
+			unsigned int diff = 0;
+			for (size_t i = 0; i < assigned.size(); ++i)
+				diff += assigned.value(i) != prev.value(i);
+			is_ok &= diff == 1;
+		}
+		assign = prev = assigned;
+		val = value;
+		if (!is_ok)
+			break;
+	}
+
+	if (!ok(is_ok, message)) {
+		diag("mismatched at assignment ", assign);
+		diag("  Got:      ", val);
+		diag("  Expected: ", ttval[idx]);
+	}
+	return is_ok;
+}
+
 static auto testfms = std::vector<Formula>{
 	{"\\T"}, {"\\F"},
 
@@ -193,7 +241,7 @@ static auto extrafms = std::vector<Formula>{
 	{"(ab&3 | x&a34) -> (\\T ^ x) -> (y = x) <-> (ab | cd ^ a34)"},
 };
 
-static bool is_eqv(const Formula& f, CNF& g, std::string message = "") {
+static bool is_eqv(const Formula& f, Conjunctive& g, std::string message = "") {
 	bool is_ok = true;
 	Assignment assign;
 
@@ -257,8 +305,44 @@ static bool is_eqv(const Formula& f, Tseitin& g, std::string message = "") {
 	return is_ok;
 }
 
+/*
+ * The Plaisted-Greenbaum transform is only equisatisfiable: lifts of
+ * assignments must be models exactly if the formula is true, and every
+ * model of the transform must project to a model of the formula.
+ */
+static bool is_equisat(const Formula& f, Tseitin& g, std::string message = "") {
+	bool is_ok = true;
+	Assignment assign, lassign;
+
+	if (message.empty())
+		message = f.to_postfix();
+
+	g.is_caching() = true;
+	assign = f.assignment();
+	while (is_ok && !assign.overflown()) {
+		is_ok &= g.eval(g.lift(assign)) == f.eval(assign);
+		++assign;
+	}
+	lassign = Assignment(g.domain->list());
+	while (is_ok && !lassign.overflown()) {
+		is_ok &= !g.eval(lassign) || f.eval(g.project(lassign));
+		++lassign;
+	}
+
+	if (!ok(is_ok, message)) {
+		diag("Tseitin clauses:");
+		for (auto cl : g)
+			diag("  ", cl);
+	}
+	return is_ok;
+}
+
 int main(void) {
-	plan(11);
+#ifdef PROPCALC_SINGLE_THREADED
+	plan(20);
+#else
+	plan(22);
+#endif
 
 	std::cout << std::boolalpha;
 
@@ -288,31 +372,477 @@ int main(void) {
 		"(a|b)^(a>c)=(~a&(a|b|x)) has 16 rows in truthtable");
 
 	SUBTEST("truthtable") {
-		plan(std::size(ttfms));
+		plan(3 * std::size(ttfms));
 		unsigned int idx = 0;
 		for (auto& f : ttfms) {
-			is_truthtable(f, ttvals[idx++]);
+			is_truthtable(f, ttvals[idx], false);
+			is_truthtable(f, ttvals[idx], true);
+			is_gray_truthtable(f, ttvals[idx]);
+			idx++;
 		}
 	}
 
 	SUBTEST("cnf") {
 		plan(std::size(testfms) + std::size(extrafms));
 		for (auto& f : testfms) {
-			CNF cnf = f.cnf();
+			CNF cnf = f.cnf(true);
+			is_eqv(f, cnf);
+		}
+		for (auto& f : extrafms) {
+			CNF cnf = f.cnf(true);
+			is_eqv(f, cnf);
+		}
+	}
+
+	SUBTEST("minimized cnf") {
+		/* Distributing (a & b) | (c & d) | ... gives 2^k prime clauses. */
+		Formula dnf3("(a1 & a2) | (a3 & a4) | (a5 & a6)");
+		Formula dnf6("(x1 & x2) | (x3 & x4) | (x5 & x6) | (x7 & x8) | (x9 & x10) | (x11 & x12)");
+		plan(std::size(testfms) + std::size(extrafms) + 6);
+		for (auto& f : testfms) {
+			CNF cnf = f.cnf(true, true);
+			is_eqv(f, cnf);
+		}
+		for (auto& f : extrafms) {
+			CNF cnf = f.cnf(true, true);
+			is_eqv(f, cnf);
+		}
+
+		CNF exact = dnf3.cnf(true, true);
+		is_eqv(dnf3, exact, "exact minimization is equivalent");
+		is(exact.size(), 8, "exact minimization finds the prime cover");
+		is(dnf3.cnf(true).cache_all(), 27, "without minimization");
+
+		CNF heuristic = dnf6.cnf(true, true);
+		is_eqv(dnf6, heuristic, "heuristic minimization is equivalent");
+		is(heuristic.size(), 64, "heuristic minimization finds the prime cover");
+		bool all_short = true;
+		for (auto cl : heuristic)
+			all_short &= cl.size() == 6;
+		ok(all_short, "heuristic clauses are prime");
+	}
+
+	SUBTEST("cnf fast path") {
+		plan(6);
+		auto clauses = [] (const Formula& f) {
+			std::vector<std::string> got;
+			for (auto cl : f.cnf()) {
+				std::ostringstream os;
+				os << cl;
+				got.push_back(os.str());
+			}
+			return got;
+		};
+
+		Formula fm("(p | ~q | r) & (~p | s) & ~s & r");
+		is(clauses(fm), std::vector<std::string>{ "{ p -q r }", "{ -p s }", "{ -s }", "{ r }" },
+			"clauses are emitted as they are");
+		is(clauses(Formula("(p | q | ~p) & (q | \\T) & (q | p | q) & (p | q)")),
+			std::vector<std::string>{ "{ p q }" }, "tautologies and repeats are left out");
+		is(clauses(Formula("\\F | q | \\F")), std::vector<std::string>{ "{ q }" },
+			"false is dropped from clauses");
+		is(clauses(Formula("\\F & \\T")), std::vector<std::string>{ "{ }" },
+			"constant conjuncts");
+
+		/* A long chain of clauses, which used to be one conjunct. */
+		std::string chain = "x0";
+		for (unsigned int i = 1; i < 100; ++i)
+			chain += " & (x" + std::to_string(i) + " | ~x" + std::to_string(i - 1) + ")";
+		CNF cnf = Formula(chain).cnf(true);
+		is(cnf.cache_all(), 100, "chain of 100 clauses");
+
+		/* The rows of a conjunct on 64 variables do not fit a shift. */
+		std::string wide = "x1";
+		for (unsigned int i = 2; i <= 64; ++i)
+			wide += " ^ x" + std::to_string(i);
+		CNF big = Formula(wide).cnf();
+		size_t n = 0;
+		for (; big && n < 3; ++big)
+			++n;
+		is(n, 3, "conjunct on 64 variables has more than one clause");
+	}
+
+#ifndef PROPCALC_SINGLE_THREADED
+	SUBTEST("cnf_parallel") {
+		plan(std::size(testfms) + std::size(extrafms) + 3);
+		for (auto& f : testfms) {
+			ParallelCNF cnf = f.cnf_parallel(3, true, true);
 			is_eqv(f, cnf);
 		}
 		for (auto& f : extrafms) {
-			CNF cnf = f.cnf();
+			ParallelCNF cnf = f.cnf_parallel(3, false, true);
 			is_eqv(f, cnf);
 		}
+
+		auto strings = [] (Conjunctive&& cnf) {
+			std::vector<std::string> got;
+			for (auto cl : cnf) {
+				std::ostringstream os;
+				os << cl;
+				got.push_back(os.str());
+			}
+			return got;
+		};
+
+		std::string chain = "(x0 | x1 ^ x2)";
+		for (unsigned int i = 1; i < 40; ++i)
+			chain += " & (x" + std::to_string(i) + " ^ x" + std::to_string(i + 1) + " ^ ~x" + std::to_string(i - 1) + ")";
+		Formula fm(chain);
+		auto expected = strings(fm.cnf());
+		is(strings(fm.cnf_parallel(4)), expected, "ordered is the same as CNF");
+		auto fastest = strings(fm.cnf_parallel(4, false));
+		std::sort(fastest.begin(), fastest.end());
+		std::sort(expected.begin(), expected.end());
+		is(fastest, expected, "unordered has the same clauses");
+		is(strings(Formula("\\T").cnf_parallel(2)), strings(Formula("\\T").cnf()),
+			"constant formula");
+	}
+#endif
+
+	SUBTEST("compiled") {
+		Formula bigfm("(a1 ^ a2 & a3 | ~a4) = (a5 > a6 ^ a7) & (a8 | a9 = ~a10)");
+		plan(2 * (std::size(testfms) + std::size(extrafms) + 2) + 3);
+		auto check = [] (const Formula& f) {
+			CompiledFormula cf(f);
+			bool is_ok = true, is_sliced_ok = true;
+			uint64_t rows = 1ULL << cf.vars().size();
+			uint64_t out[8];
+			uint64_t row = 0;
+			auto assign = f.assignment();
+			while (!assign.overflown()) {
+				bool expected = f.eval(assign);
+				is_ok &= cf.eval(assign) == expected;
+				if (row % 512 == 0)
+					cf.eval_rows(row, out, 8);
+				/* Rows past the end of the table repeat it. */
+				for (uint64_t r = row % 512; r < 512; r += rows)
+					is_sliced_ok &= ((out[r / 64] >> (r % 64)) & 1) == expected;
+				++assign;
+				++row;
+			}
+			ok(is_ok, f.to_postfix());
+			ok(is_sliced_ok, f.to_postfix() + " (sliced)");
+		};
+		for (auto& f : testfms)
+			check(f);
+		for (auto& f : extrafms)
+			check(f);
+		check(bigfm);
+		check(bigfm.flatten());
+
+		/* Each level uses the previous one twice, so the tree has
+		 * 2^30 leaves but the DAG only 2 nodes per level. */
+		Formula a("a"), x("x"), shared = a;
+		for (unsigned int i = 0; i < 30; ++i)
+			shared = (shared & shared) | x;
+		CompiledFormula cf(shared);
+		is(cf.vars().size(), 2, "shared chain has two variables");
+		is(cf.program().size(), 2 * 30, "shared chain compiles to one instruction per node");
+		bool is_ok = true;
+		for (bool va : { false, true }) {
+			for (bool vx : { false, true })
+				is_ok &= cf.eval(Assignment({{ a.vars()[0], va }, { x.vars()[0], vx }})) == (va || vx);
+		}
+		ok(is_ok, "shared chain evaluates like a | x");
+	}
+
+	SUBTEST("truthtable_bits") {
+		Formula bigfm("(a1 ^ a2 & a3 | ~a4) = (a5 > a6 ^ a7) & (a8 | a9 = ~a10)");
+		plan(std::size(testfms) + std::size(extrafms) + 5);
+		auto check = [] (const Formula& f) {
+			Bittable bt = f.truthtable_bits();
+			bool is_ok = bt.size() == 1ULL << f.vars().size();
+			uint64_t row = 0, sat = 0;
+			auto it = bt.begin();
+			auto tt = f.truthtable();
+			tt.cache_all();
+			for (const auto& [assign, value] : tt) {
+				is_ok &= bt[row] == value;
+				is_ok &= bt.rank(assign) == row && bt.unrank(row) == assign;
+				if (value) {
+					is_ok &= it != bt.end() && *it == row;
+					++it;
+					++sat;
+				}
+				++row;
+			}
+			is_ok &= it == bt.end() && bt.count() == sat;
+			return ok(is_ok, f.to_postfix());
+		};
+		for (auto& f : testfms)
+			check(f);
+		for (auto& f : extrafms)
+			check(f);
+		check(bigfm);
+
+		Bittable bt = bigfm.truthtable_bits();
+		is(bt.words().size(), 16, "1024 rows fit in 16 words");
+		ok(bt == bigfm.truthtable_bits(), "equal formulas have equal tables");
+		ok(bt != (~bigfm).truthtable_bits(), "negation has a different table");
+		is(bt.count() + (~bigfm).truthtable_bits().count(), 1024, "negation complements the count");
+	}
+
+#ifndef PROPCALC_SINGLE_THREADED
+	SUBTEST("truthtable_parallel") {
+		Formula bigfm("(a1 ^ a2 & a3 | ~a4) = (a5 > a6 ^ a7) & (a8 | a9 = ~a10)");
+		plan(std::size(testfms) + std::size(extrafms) + 4);
+		auto check = [] (const Formula& f) {
+			Bittable bt = f.truthtable_bits();
+			std::vector<uint64_t> expected(bt.begin(), bt.end());
+			bool is_ok = true;
+			for (unsigned int threads : { 1, 3 }) {
+				for (int prefix : { -1, 0, 2, 64 }) {
+					ParallelTruthtable pt(f, threads, prefix);
+					is_ok &= pt.count() == bt.count();
+					is_ok &= pt.satisfying() == expected;
+
+					std::mutex lock;
+					std::vector<uint64_t> rows;
+					pt.for_each([&] (uint64_t r) {
+						const std::lock_guard<std::mutex> guard(lock);
+						rows.push_back(r);
+					});
+					std::sort(rows.begin(), rows.end());
+					is_ok &= rows == expected;
+				}
+			}
+			return ok(is_ok, f.to_postfix());
+		};
+		for (auto& f : testfms)
+			check(f);
+		for (auto& f : extrafms)
+			check(f);
+		check(bigfm);
+
+		ParallelTruthtable pt(bigfm, 4, 3);
+		is(pt.shards(), 8, "prefix of 3 variables makes 8 shards");
+		throws<std::runtime_error>([&] {
+			pt.for_each([] (uint64_t r) {
+				if (r > 500)
+					throw std::runtime_error("enough");
+			}, true);
+		}, "exception from ordered sink is rethrown");
+		throws<std::runtime_error>([&] {
+			pt.for_each([] (uint64_t r) {
+				if (r > 500)
+					throw std::runtime_error("enough");
+			});
+		}, "exception from unordered sink is rethrown");
+	}
+#endif
+
+	SUBTEST("truthtable ranges") {
+		Formula bigfm("(a1 ^ a2 & a3 | ~a4) = (a5 > a6 ^ a7) & (a8 | a9 = ~a10)");
+		plan(6);
+		for (bool gray : { false, true }) {
+			for (bool sliced : { false, true }) {
+				if (gray && sliced)
+					continue;
+				auto whole = Truthtable(bigfm, sliced, gray);
+				whole.cache_all();
+				std::vector<std::pair<Assignment, bool>> expected(whole.begin(), whole.end());
+
+				/* Concatenate ranges which are not aligned to blocks. */
+				std::vector<std::pair<Assignment, bool>> got;
+				for (auto range : std::vector<Truthtable::Range>{ {0, 100}, {100, 700}, {700, 5000} }) {
+					Truthtable tt(bigfm, range, sliced, gray);
+					tt.cache_all();
+					got.insert(got.end(), tt.begin(), tt.end());
+				}
+				std::string mode = gray ? "gray" : sliced ? "sliced" : "lexicographic";
+				ok(got == expected, "ranges concatenate to the truthtable, " + mode);
+			}
+		}
+
+		Truthtable tt(bigfm, {1000, 1000});
+		is(tt.cache_all(), 0, "empty range");
+		Truthtable past(bigfm, {2000, 3000});
+		is(past.cache_all(), 0, "range past the end");
+		Truthtable one(bigfm, {0x2A5, 0x2A6});
+		one.cache_all();
+		is((*one.begin()).first.rank(), 0x2A5, "range starts at the rank");
 	}
 
 	SUBTEST("tseitin") {
-		plan(std::size(testfms));
+		plan(std::size(testfms) + 9);
 		for (auto& f : testfms) {
-			Tseitin tsei = f.tseitin();
+			Tseitin tsei = f.tseitin(true);
 			is_eqv(f, tsei);
 		}
+
+		/* Each level uses the previous one twice. */
+		Formula chain("x0");
+		for (unsigned int i = 1; i <= 10; ++i) {
+			Formula x("x" + std::to_string(i)), y("y" + std::to_string(i));
+			chain = chain.andf(x).orf(chain.xorf(y));
+		}
+		is(chain.tseitin(true).cache_all(), 1 + 10 * (3 + 4 + 3), "shared subtrees are defined once");
+		is(Formula("(a & b) | ~(a & b)").tseitin(true).cache_all(), 1 + 3 + 2 + 3,
+			"equal subtrees are defined once");
+
+		Tseitin tsei = Formula("(a1 ^ ~a2) | (\\T -> (a2 = a1) & a3)").tseitin();
+		bool lazy = true, found = true;
+		for (auto v : tsei.domain->list()) {
+			lazy &= v->name.empty();
+			found &= tsei.domain->resolve(v->get_name()) == v;
+		}
+		ok(lazy, "names are not computed up front");
+		ok(found, "variables are found by name");
+
+		/* Failed lookups leave the source domain alone. */
+		Cache src;
+		Formula ab("[a] | [b]", &src);
+		Tseitin named = ab.tseitin();
+		throws<std::out_of_range>([&] { named.domain->resolve("Tseitin[[zz] | [qq]]"); },
+			"unknown variables in a name");
+		throws<std::out_of_range>([&] { named.domain->resolve("Tseitin[[a] |]"); },
+			"malformed name");
+		is(src.size(), 2, "source domain is unchanged");
+		src.freeze();
+		ok(named.domain->resolve("Tseitin[[a] | [b]]") == named.domain->list()[0],
+			"lookup in a frozen source");
+		throws<std::out_of_range>([&] { named.domain->resolve("Tseitin[[c]]"); },
+			"unknown variable in a frozen source");
+		src.thaw();
+	}
+
+	SUBTEST("tseitin polarity") {
+		plan(std::size(testfms) + std::size(extrafms) + 2);
+		for (auto& f : testfms) {
+			Tseitin tsei = f.tseitin(true, true);
+			is_equisat(f, tsei);
+		}
+		for (auto& f : extrafms) {
+			Tseitin tsei = f.tseitin(true, true);
+			is_equisat(f, tsei);
+		}
+
+		/* Monotone formulas get one direction per node. */
+		Formula fm("(a & b) | (c & ~d) | ~(e | f)");
+		is(fm.tseitin(true).cache_all(), 1 + 5 * 3 + 2 * 2, "full transform");
+		is(fm.tseitin(true, true).cache_all(), 1 + 2 + 2 + 1 + 2 + 1 + 1 + 1, "polarity transform");
+	}
+
+	SUBTEST("tseitin n-ary") {
+		plan(std::size(testfms) + std::size(extrafms) + 6);
+		for (auto& f : testfms) {
+			Tseitin tsei = f.flatten().tseitin(true);
+			is_eqv(f, tsei, f.to_postfix() + " (flattened)");
+		}
+		for (auto& f : extrafms) {
+			Tseitin tsei = f.flatten().tseitin(true, true);
+			is_equisat(f, tsei, f.to_postfix() + " (flattened, polarity)");
+		}
+
+		/* One variable per n-ary node, not per binary one. */
+		Formula fm = Formula("a & b & c & d | e").flatten();
+		Tseitin tsei = fm.tseitin(true);
+		is(tsei.domain->list().size(), 5 + 2, "one variable per n-ary node");
+		is(tsei.cache_all(), 1 + (4 + 1) + (2 + 1), "clauses of n-ary nodes");
+
+		/* A wide parity is split into two halves. */
+		std::string parity = "x1";
+		for (unsigned int i = 2; i <= 6; ++i)
+			parity += " ^ x" + std::to_string(i);
+		Formula xfm = Formula(parity).flatten();
+		Tseitin xtsei = xfm.tseitin(true);
+		is(xtsei.domain->list().size(), 6 + 3, "wide parity gets three variables");
+		is(xtsei.cache_all(), 1 + 4 + 2 * 8, "clauses of the wide parity");
+		is_equisat(xfm, xtsei, "wide parity");
+
+		bool found = true;
+		for (auto v : tsei.domain->list())
+			found &= tsei.domain->resolve(v->get_name()) == v;
+		ok(found, "n-ary variables are found by name");
+	}
+
+	SUBTEST("tseitin incremental") {
+		plan(8);
+		Formula f1("(a & b) | (c ^ d)"), f2("~(a & b) -> (c ^ d) & e"), f3("c ^ d");
+
+		Tseitin::Incremental enc;
+		ok(!enc, "empty encoder");
+		enc.add(f1);
+		size_t n1 = 0;
+		for (auto cl : enc)
+			n1++;
+		is(n1, 1 + 3 + 3 + 4, "clauses of the first formula");
+
+		/* Only ~(a & b), the And with e, the Impl and the assertion are new. */
+		enc.add(f2);
+		ok(!!enc, "valid again after adding");
+		size_t n2 = 0;
+		for (auto cl : enc)
+			n2++;
+		is(n2, 1 + 2 + 3 + 3, "only new clauses for the second formula");
+
+		enc.add(f3).add(f1);
+		ok(!!enc && !++enc, "a known subtree only needs its assertion");
+
+		Tseitin::Incremental all(&Formula::DefaultDomain, true);
+		all.add(f1).add(f2).add(f3);
+		is_eqv(f1 & f2 & f3, all, "equivalent to the transform of the conjunction");
+		/* The subtree a | b occurs negatively only in the second formula. */
+		Tseitin::Incremental pg(&Formula::DefaultDomain, true, true);
+		Formula g1("(a | b) & c"), g2("(a | b) -> d");
+		pg.add(g1).add(g2);
+		is_equisat(g1 & g2, pg, "polarity mode across formulas");
+
+		throws<std::invalid_argument>([&] {
+			Cache other;
+			enc.add(Formula("a", &other));
+		}, "formulas must be on the source domain");
+	}
+
+	SUBTEST("hybrid") {
+		plan(3 * std::size(testfms) + 11);
+		for (auto budget : { 0, 4, 64 }) {
+			for (auto& f : testfms) {
+				Hybrid hyb = f.hybrid(budget, true);
+				is_eqv(f, hyb, f.to_postfix() + " with budget " + std::to_string(budget));
+			}
+		}
+
+		is(Hybrid::estimate(Formula("a | ~b | c").root), 1, "estimate of a clause");
+		is(Hybrid::estimate(Formula("(a & b) | (c & d)").root), 4, "estimate by distribution");
+		is(Hybrid::estimate(Formula("a ^ b").root), 2, "estimate of xor");
+		is(Hybrid::estimate(Formula("a = b = c = d").root), 8, "estimate of a chain of equivalences");
+		is(Hybrid::estimate(Formula("(a & b) | (a & b) | (a & b) | (a & b) | (a & b)").root), 4,
+			"estimate capped by rows");
+		std::string wide = "(x1 & x2)";
+		for (unsigned int i = 3; i <= 21; ++i)
+			wide += " | x" + std::to_string(i);
+		is(Hybrid::estimate(Formula(wide).root), uint64_t(1) << 21,
+			"estimate of a non-clause on more than MAX_VARS variables");
+		Formula dag("a | b");
+		for (unsigned int i = 0; i < 100; ++i)
+			dag = dag & (dag | Formula("c"));
+		is(Hybrid::estimate(dag.root), 8, "estimate of a DAG with 2^100 paths");
+
+		/* A clausal conjunct stays, the big parity gets auxiliary variables. */
+		std::string parity = "x1";
+		for (unsigned int i = 2; i <= 12; ++i)
+			parity += " ^ x" + std::to_string(i);
+		Formula fm("(x1 | ~x2) & (" + parity + ")");
+		Hybrid hyb = fm.hybrid(16, true);
+		size_t count = hyb.cache_all();
+		is(count, 1 + 1 + 4 * 11, "mixed encoding");
+
+		/* A deep chain, shared with the unique table, is bounded without recursion. */
+		const size_t depth = 300000;
+		Formula chain("x0");
+		for (size_t i = 1; i < depth; ++i)
+			chain = Formula("x" + std::to_string(i % 16)) | ~chain;
+		Hybrid deep = chain.hybrid();
+		ok(deep.cache_all() > depth, "deep chain");
+
+		/* A DAG with 2^30 paths which is equivalent to a | x. */
+		Formula shared("a");
+		for (unsigned int i = 0; i < 30; ++i)
+			shared = (shared & shared) | Formula("x");
+		Hybrid direct = shared.hybrid(64, true);
+		is(direct.cache_all(), 1, "shared DAG is one clause");
+		is(direct.domain->size(), 2, "variables of a shared DAG");
 	}
 
 	return EXIT_SUCCESS;
@@ -0,0 +1,116 @@
+#include <tappp/tappp.hpp>
+#include <propcalc/propcalc.hpp>
+#include <propcalc/clausebuf.hpp>
+
+#include <cstdlib>
+#include <utility>
+
+using namespace TAP;
+using namespace Propcalc;
+
+static std::vector<VarRef> make_vars(unsigned int n) {
+	std::vector<VarRef> vars;
+	for (unsigned int i = 1; i <= n; ++i)
+		vars.push_back(Formula::DefaultDomain.resolve("v" + std::to_string(i)));
+	return vars;
+}
+
+int main(void) {
+	plan(6);
+
+	SUBTEST(6, "values and positions") {
+		auto vars = make_vars(40);
+		VarMap small({ { vars[0], true }, { vars[1], false } });
+		is(small.position(vars[1]), 1, "position in small map");
+		is(small.position(vars[2]), VarMap::npos, "missing variable has no position");
+		throws<std::out_of_range>([&] { (void) std::as_const(small)[vars[2]]; },
+			"reading a missing variable throws");
+
+		VarMap large(vars);
+		large[vars[37]] = true;
+		large[vars[37]] ^= true;
+		large[vars[38]] = large[vars[0]] = true;
+		is(large.position(vars[39]), 39, "position in indexed map");
+		ok(large[vars[0]] && !large[vars[37]] && large[vars[38]], "proxy assignment");
+
+		VarMap copy(large);
+		copy[Formula::DefaultDomain.resolve("w")] = true;
+		ok(!large.exists(Formula::DefaultDomain.resolve("w")) && copy.size() == 41,
+			"copies have separate indices after adding a variable");
+	}
+
+	SUBTEST(4, "increment") {
+		auto vars = make_vars(70);
+		Assignment assign(vars);
+		for (unsigned int i = 0; i < 64; ++i)
+			assign[vars[i]] = true;
+		++assign;
+		ok(!assign[vars[0]] && !assign[vars[63]] && assign[vars[64]],
+			"carry into the second word");
+		ok(!assign.overflown(), "no overflow yet");
+
+		Assignment last = ~Assignment(vars);
+		++last;
+		ok(last.overflown(), "all-true assignment overflows");
+		ok(last == Assignment(vars), "to all-false");
+	}
+
+	SUBTEST(3, "negation") {
+		auto vars = make_vars(3);
+		Assignment assign({ { vars[0], true }, { vars[1], false }, { vars[2], true } });
+		is(~assign, Assignment({ { vars[0], false }, { vars[1], true }, { vars[2], false } }),
+			"negated assignment");
+		Clause cl({ { vars[0], true }, { vars[2], true } });
+		ok(!(~cl).eval(assign), "negated clause is falsified");
+		ok(cl.eval(assign), "clause is satisfied");
+	}
+
+	SUBTEST(2, "clause evaluation") {
+		auto vars = make_vars(20);
+		Assignment assign(vars);
+		Clause cl({ { vars[19], true } });
+		ok(!cl.eval(assign), "large assignment falsifies");
+		assign[vars[19]] = true;
+		ok(cl.eval(assign), "large assignment satisfies");
+	}
+
+	SUBTEST(5, "rank and unrank") {
+		auto vars = make_vars(70);
+		std::vector<VarRef> few(vars.begin(), vars.begin() + 10);
+		Assignment assign(few, 0x2A5);
+		is(assign.rank(), 0x2A5, "rank of unranked assignment");
+		Assignment step(few);
+		for (unsigned int i = 0; i < 0x2A5; ++i)
+			++step;
+		ok(step == assign, "unrank agrees with increment");
+
+		std::vector<VarRef> reversed(few.rbegin(), few.rend());
+		is(assign.rank(reversed), 0x295, "rank in reversed order");
+		is(Assignment(few, ~uint64_t(0)).rank(), 0x3FF, "excess bits are ignored");
+		throws<std::length_error>([&] { (void) Assignment(vars).rank(); },
+			"rank of more than 64 variables throws");
+	}
+
+	SUBTEST(5, "clause buffer") {
+		auto vars = make_vars(20);
+		ClauseBuffer buf;
+		buf.push({ { vars[0], true }, { vars[1], false } });
+		buf.push(Clause(std::vector<VarRef>(vars.begin(), vars.end())));
+		buf.push({ });
+		is(buf.size(), 3, "three clauses in the buffer");
+
+		Clause cl({ { vars[5], true } });
+		buf.pop(cl);
+		ok(cl == Clause({ { vars[0], true }, { vars[1], false } }), "first clause replaces the old one");
+		buf.pop(cl);
+		ok(cl == Clause(vars), "long clause");
+		buf.pop(cl);
+		ok(buf.empty() && cl.size() == 0, "empty clause");
+
+		Clause neg;
+		neg.forbid(Assignment(vars, 0x5));
+		is(neg.words(), std::vector<uint64_t>{ 0xFFFFA }, "clause forbidding an assignment");
+	}
+
+	return EXIT_SUCCESS;
+}